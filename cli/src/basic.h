@@ -65,16 +65,29 @@ struct PathInfo {
     size_t dstLen;
 };
 
+// 解析阶段校验通过的挂载源身份，挂载阶段据此确认源未被替换
+struct MountSource {
+    bool checked;
+    bool verified;
+    dev_t dev;
+    ino_t ino;
+    mode_t mode;
+};
+
 struct MountList {
     unsigned int count;
     char list[MAX_MOUNT_NR][PATH_MAX];
+    struct MountSource sources[MAX_MOUNT_NR];
 };
 
 struct ParsedConfig {
     char rootfs[BUF_SIZE];
     char containerNsPath[BUF_SIZE];
+    char mountInfoPath[BUF_SIZE];
     char cgroupPath[BUF_SIZE];
+    char stagingDir[BUF_SIZE];
     int  originNsFd;
+    int  rootfsFd;
     const struct MountList *files;
     const struct MountList *dirs;
 };
@@ -30,21 +30,38 @@
 #include "u_mount.h"
 #include "cgrp.h"
 #include "options.h"
+#include "staging.h"
+#include "pipeline.h"
+#include "oci.h"
+#include "white_list.h"
 #include "utils.h"
 #include "logger.h"
 
 #define DECIMAL     10
 #define MAX_ARGC    1024
 #define MAX_ARG_LEN 1024
+#define MAX_TARGET_NR 64
+#define MAX_FD_LEN  10
+#define PRESTART_NO_DEVICE 1
 
 bool g_allowLink = false;
 
+// 一次调用可为多个容器挂载，--pid与--rootfs按出现顺序配对
+struct Target {
+    char rootfs[BUF_SIZE];
+    long pid;
+};
+
 struct CmdArgs {
     char     rootfs[BUF_SIZE];
     long      pid;
     char     options[BUF_SIZE];
     struct MountList files;
     struct MountList dirs;
+    char     sourceFds[BUF_SIZE];
+    struct Target targets[MAX_TARGET_NR];
+    unsigned int pidNr;
+    unsigned int rootfsNr;
 };
 
 static struct option g_cmdOpts[] = {
@@ -55,6 +72,8 @@ static struct option g_cmdOpts[] = {
     {"options", required_argument, 0, 'o'},
     {"mount-file", required_argument, 0, 'f'},
     {"mount-dir", required_argument, 0, 'i'},
+    {"source-fds", required_argument, 0, 's'},
+    {"prestart", no_argument, 0, 'P'},
     {0, 0, 0, 0}
 };
 
@@ -68,7 +87,12 @@ static bool PidCmdArgParser(struct CmdArgs *args, const char *arg)
         Logger("args, arg pointer is null!", LEVEL_ERROR, SCREEN_YES);
         return false;
     }
+    if (args->pidNr >= MAX_TARGET_NR) {
+        Logger("too many pids!", LEVEL_ERROR, SCREEN_YES);
+        return false;
+    }
     args->pid = strtol(arg, NULL, DECIMAL);
+    args->targets[args->pidNr++].pid = args->pid;
     const char* pidMax = "/proc/sys/kernel/pid_max";
     const size_t maxFileSzieMb = 10; // max 10MB
     if (!CheckExternalFile(pidMax, strlen(pidMax), maxFileSzieMb, true)) {
@@ -141,6 +165,10 @@ static bool RootfsCmdArgParser(struct CmdArgs *args, const char *arg)
         return false;
     }
 
+    if (args->rootfsNr >= MAX_TARGET_NR) {
+        Logger("too many rootfs!", LEVEL_ERROR, SCREEN_YES);
+        return false;
+    }
     errno_t err = strcpy_s(args->rootfs, BUF_SIZE, arg);
     if (err != EOK) {
         Logger("failed to get rootfs path from cmd args", LEVEL_ERROR, SCREEN_YES);
@@ -151,6 +179,9 @@ static bool RootfsCmdArgParser(struct CmdArgs *args, const char *arg)
         Logger("failed to check rootf.", LEVEL_ERROR, SCREEN_YES);
         return false;
     }
+    if (strcpy_s(args->targets[args->rootfsNr++].rootfs, BUF_SIZE, args->rootfs) != EOK) {
+        return false;
+    }
 
     return true;
 }
@@ -168,9 +199,7 @@ static bool OptionsCmdArgParser(struct CmdArgs *args, const char *arg)
         return false;
     }
 
-    if ((strcmp(args->options, "NODRV,VIRTUAL") != 0) &&
-        (strcmp(args->options, "NODRV") != 0) &&
-        (strcmp(args->options, "VIRTUAL") != 0)) {
+    if (!IsValidRuntimeOptions(args->options)) {
         Logger("Whitelist check failed.", LEVEL_ERROR, SCREEN_YES);
         return false;
     }
@@ -184,22 +213,8 @@ static bool CheckWhiteList(const char* fileName)
         return false;
     }
     bool fileExists = false;
-    const char mountWhiteList[WHITE_LIST_NUM][PATH_MAX] = {{"/usr/local/Ascend/driver/lib64"},
-        {"/usr/local/Ascend/driver/include"}, {"/usr/local/dcmi"}, {"/usr/local/bin/npu-smi"},
-        {"/home/data/miniD/driver/lib64"}, {"/usr/local/sbin/npu-smi"},
-        {"/usr/local/Ascend/driver/tools"}, {"/etc/hdcBasic.cfg"}, {"/etc/sys_version.conf"},
-        {"/etc/ld.so.conf.d/mind_so.conf"}, {"/etc/slog.conf"}, {"/var/dmp_daemon"}, {"/var/slogd"},
-        {"/usr/lib64/libsemanage.so.2"}, {"/usr/lib64/libmmpa.so"}, {"/usr/lib64/libcrypto.so.1.1"},
-        {"/usr/lib64/libdrvdsmi.so"}, {"/usr/lib64/libdcmi.so"}, {"/usr/lib64/libstackcore.so"},
-        {"/usr/lib64/libmpi_dvpp_adapter.so"}, {"/usr/lib64/libaicpu_scheduler.so"},
-        {"/usr/lib64/libaicpu_processer.so"}, {"/usr/lib64/libaicpu_prof.so"}, {"/usr/lib64/libaicpu_sharder.so"},
-        {"/usr/lib64/libadump.so"}, {"/usr/lib64/libtsd_eventclient.so"},
-        {"/usr/lib64/aicpu_kernels"}, {"/usr/lib64/libyaml-0.so.2"},
-        {"/usr/lib/aarch64-linux-gnu/libyaml-0.so.2"}, {"/usr/lib/aarch64-linux-gnu/libcrypto.so.1.1"}
-        };
-
     for (size_t iLoop = 0; iLoop < WHITE_LIST_NUM; iLoop++) {
-        if (strcmp(mountWhiteList[iLoop], fileName) == 0) {
+        if (strcmp(g_mountWhiteList[iLoop], fileName) == 0) {
             fileExists = true;
             break;
         }
@@ -242,7 +257,6 @@ static bool MountFileCmdArgParser(struct CmdArgs *args, const char *arg)
         free(str);
         return false;
     }
-
     return CheckWhiteList(dst) ? true : false;
 }
 
@@ -273,10 +287,30 @@ static bool MountDirCmdArgParser(struct CmdArgs *args, const char *arg)
         Logger("failed to check dir.", LEVEL_ERROR, SCREEN_YES);
         return false;
     }
-
     return CheckWhiteList(dst) ? true : false;
 }
 
+static bool SourceFdsCmdArgParser(struct CmdArgs *args, const char *arg)
+{
+    if (args == NULL || arg == NULL) {
+        Logger("args, arg pointer is null!", LEVEL_ERROR, SCREEN_YES);
+        return false;
+    }
+
+    errno_t err = strcpy_s(args->sourceFds, BUF_SIZE, arg);
+    if (err != EOK) {
+        Logger("failed to get source fds from cmd args", LEVEL_ERROR, SCREEN_YES);
+        return false;
+    }
+    for (size_t iLoop = 0; iLoop < strlen(args->sourceFds); iLoop++) {
+        if ((isdigit(args->sourceFds[iLoop]) == 0) && (args->sourceFds[iLoop] != ',')) {
+            Logger("invalid source fds value!", LEVEL_ERROR, SCREEN_YES);
+            return false;
+        }
+    }
+    return true;
+}
+
 static bool LinkCheckCmdArgParser(const char *argv)
 {
     if (argv == NULL) {
@@ -297,7 +331,7 @@ static bool LinkCheckCmdArgParser(const char *argv)
     return false;
 }
 
-#define NUM_OF_CMD_ARGS 6
+#define NUM_OF_CMD_ARGS 7
 
 static struct {
     const char c;
@@ -308,7 +342,8 @@ static struct {
     {'r', RootfsCmdArgParser},
     {'o', OptionsCmdArgParser},
     {'f', MountFileCmdArgParser},
-    {'i', MountDirCmdArgParser}
+    {'i', MountDirCmdArgParser},
+    {'s', SourceFdsCmdArgParser}
 };
 
 static int ParseOneCmdArg(struct CmdArgs *args, char indicator, const char *value)
@@ -324,6 +359,10 @@ static int ParseOneCmdArg(struct CmdArgs *args, char indicator, const char *valu
             break;
         }
     }
+    if (i == NUM_OF_CMD_ARGS) {
+        Logger("unknown cmd arg.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
 
     bool isOK;
     if (i == 0) {
@@ -347,7 +386,102 @@ static inline bool IsCmdArgsValid(const struct CmdArgs *args)
         Logger("args pointer is null!", LEVEL_ERROR, SCREEN_YES);
         return false;
     }
-    return (strlen(args->rootfs) > 0) && (args->pid > 0);
+    if ((args->pidNr == 0) || (args->pidNr != args->rootfsNr)) {
+        return false;
+    }
+    for (unsigned int i = 0; i < args->pidNr; i++) {
+        if ((strlen(args->targets[i].rootfs) == 0) || (args->targets[i].pid <= 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static struct MountSource *GetNthMountSource(struct CmdArgs *args, unsigned int index, const char **path)
+{
+    if (index < args->files.count) {
+        *path = (const char *)&args->files.list[index][0];
+        return &args->files.sources[index];
+    }
+    index -= args->files.count;
+    if (index < args->dirs.count) {
+        *path = (const char *)&args->dirs.list[index][0];
+        return &args->dirs.sources[index];
+    }
+    return NULL;
+}
+
+// 未传入fd时按路径校验，已校验的源不再重复校验
+static int VerifyPathSources(struct CmdArgs *args)
+{
+    const char *path = NULL;
+    struct MountSource *source = NULL;
+    unsigned int index = 0;
+    while ((source = GetNthMountSource(args, index++, &path)) != NULL) {
+        if (!EnsureMountSourceVerified(path, source)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// token须为纯数字, 且是hook以O_PATH打开后传入的fd, 不接受标准输入输出
+bool ParseSourceFd(const char *token, int *fd)
+{
+    if (token == NULL || fd == NULL) {
+        return false;
+    }
+    size_t len = strlen(token);
+    if (len == 0 || len > MAX_FD_LEN) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (isdigit((unsigned char)token[i]) == 0) {
+            return false;
+        }
+    }
+    long value = strtol(token, NULL, DECIMAL);
+    if (value <= STDERR_FILENO || value > INT_MAX) {
+        return false;
+    }
+    int flags = fcntl((int)value, F_GETFL);
+    if (fcntl((int)value, F_GETFD) < 0 || flags < 0 || (flags & O_PATH) == 0) {
+        return false;
+    }
+    *fd = (int)value;
+    return true;
+}
+
+// hook传入的fd依次对应--mount-file与--mount-dir
+static int VerifyFdSources(struct CmdArgs *args)
+{
+    const char *path = NULL;
+    struct MountSource *source = NULL;
+    unsigned int index = 0;
+    char *context = NULL;
+    for (char *token = strtok_s(args->sourceFds, ",", &context); token != NULL;
+        token = strtok_s(NULL, ",", &context)) {
+        source = GetNthMountSource(args, index++, &path);
+        if (source == NULL) {
+            Logger("source fds do not match mount list.", LEVEL_ERROR, SCREEN_YES);
+            return -1;
+        }
+        int fd = -1;
+        if (!ParseSourceFd(token, &fd)) {
+            Logger("invalid source fd.", LEVEL_ERROR, SCREEN_YES);
+            return -1;
+        }
+        bool verified = VerifyMountSourceFd(path, fd, source);
+        close(fd);
+        if (!verified) {
+            return -1;
+        }
+    }
+    if (index != args->files.count + args->dirs.count) {
+        Logger("source fds do not match mount list.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    return 0;
 }
 
 int DoPrepare(const struct CmdArgs *args, struct ParsedConfig *config)
@@ -374,6 +508,14 @@ int DoPrepare(const struct CmdArgs *args, struct ParsedConfig *config)
         return -1;
     }
 
+    ret = GetMountInfoPath(args->pid, config->mountInfoPath, BUF_SIZE);
+    if (ret < 0) {
+        char* str = FormatLogMessage("failed to get container mountinfo path: pid(%ld).", args->pid);
+        Logger(str, LEVEL_ERROR, SCREEN_YES);
+        free(str);
+        return -1;
+    }
+
     char originNsPath[BUF_SIZE] = {0};
     ret = GetSelfNsPath("mnt", originNsPath, BUF_SIZE);
     if (ret < 0) {
@@ -389,6 +531,8 @@ int DoPrepare(const struct CmdArgs *args, struct ParsedConfig *config)
         return -1;
     }
 
+    config->rootfsFd = -1;
+    config->stagingDir[0] = '\0';
     config->files = (const struct MountList *)&args->files;
     config->dirs  = (const struct MountList *)&args->dirs;
 
@@ -412,6 +556,27 @@ int SetupContainer(struct CmdArgs *args)
         return -1;
     }
 
+    // 常规模式由子进程进入容器挂载，本进程留在宿主机命名空间边校验边下发
+    if (!IsOptionStagingSet() && !IsOptionNoDrvSet()) {
+        close(config.originNsFd);
+        Logger("do mounting", LEVEL_INFO, SCREEN_YES);
+        ret = DoPipelinedMounting(&config, &args->files, &args->dirs);
+        if (ret < 0) {
+            Logger("failed to do mounting.", LEVEL_ERROR, SCREEN_YES);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (VerifyPathSources(args) < 0) {
+        Logger("failed to verify mount sources.", LEVEL_ERROR, SCREEN_YES);
+        close(config.originNsFd);
+        return -1;
+    }
+    if (IsOptionStagingSet() && !IsOptionNoDrvSet() && PrepareStaging(&config) < 0) {
+        Logger("failed to prepare staging dir, mount entries one by one.", LEVEL_WARN, SCREEN_YES);
+    }
+
     // enter container's mount namespace
     Logger("enter container's mount namespace", LEVEL_INFO, SCREEN_YES);
     ret = EnterNsByPath((const char *)config.containerNsPath, CLONE_NEWNS);
@@ -422,8 +587,16 @@ int SetupContainer(struct CmdArgs *args)
         close(config.originNsFd);
         return -1;
     }
+    // 容器内所有挂载目标均相对该fd解析，避免越出rootfs
+    config.rootfsFd = open((const char *)config.rootfs, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (config.rootfsFd < 0) {
+        Logger("failed to open rootfs.", LEVEL_ERROR, SCREEN_YES);
+        close(config.originNsFd);
+        return -1;
+    }
     Logger("do mounting", LEVEL_INFO, SCREEN_YES);
     ret = DoMounting(&config);
+    close(config.rootfsFd);
     if (ret < 0) {
         Logger("failed to do mounting.", LEVEL_ERROR, SCREEN_YES);
         close(config.originNsFd);
@@ -443,6 +616,62 @@ int SetupContainer(struct CmdArgs *args)
     return 0;
 }
 
+// 挂载源只校验一次，各容器依次挂载，单个容器失败不影响其余容器
+static int SetupTargets(struct CmdArgs *args)
+{
+    unsigned int failedNr = 0;
+    for (unsigned int i = 0; i < args->pidNr; i++) {
+        args->pid = args->targets[i].pid;
+        if (strcpy_s(args->rootfs, BUF_SIZE, args->targets[i].rootfs) != EOK) {
+            failedNr++;
+            continue;
+        }
+        Logger("setup container config ...", LEVEL_INFO, SCREEN_YES);
+        int ret = SetupContainer(args);
+        if (args->pidNr > 1) {
+            char* str = FormatLogMessage("setup container pid(%ld): %s.", args->pid, (ret < 0) ? "failed" : "ok");
+            Logger(str, (ret < 0) ? LEVEL_ERROR : LEVEL_INFO, SCREEN_YES);
+            free(str);
+        }
+        if (ret < 0) {
+            Logger("failed to setup container.", LEVEL_ERROR, SCREEN_YES);
+            failedNr++;
+        }
+    }
+    if (failedNr > 0) {
+        return -1;
+    }
+    Logger("prestart-hook setup container successful.", LEVEL_INFO, SCREEN_YES);
+    return 0;
+}
+
+// 作为prestart钩子运行时，容器信息取自标准输入的state及bundle下的config.json，挂载项由runtime解析挂载配置后经参数传入
+static int ParsePrestartArgs(struct CmdArgs *args)
+{
+    struct OciHookInfo info;
+    if ((ReadOciState(stdin, &info) < 0) || (ReadOciConfig(&info) < 0)) {
+        Logger("failed to get container config.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    if (strlen(info.visibleDevices) == 0) {
+        return PRESTART_NO_DEVICE;
+    }
+
+    char pid[BUF_SIZE] = {0};
+    if (sprintf_s(pid, BUF_SIZE, "%ld", info.pid) < 0) {
+        return -1;
+    }
+    const char *allowLink = (strlen(info.allowLink) == 0) ? "False" : info.allowLink;
+    if ((ParseOneCmdArg(args, 'l', allowLink) < 0) || (ParseOneCmdArg(args, 'p', pid) < 0) ||
+        (ParseOneCmdArg(args, 'r', info.rootfs) < 0)) {
+        return -1;
+    }
+    if ((strlen(info.runtimeOptions) > 0) && (ParseOneCmdArg(args, 'o', info.runtimeOptions) < 0)) {
+        return -1;
+    }
+    return 0;
+}
+
 int Process(int argc, char **argv)
 {
     if (argv == NULL) {
@@ -455,31 +684,47 @@ int Process(int argc, char **argv)
     }
     int c;
     int ret;
+    bool prestart = false;
+    bool containerArgs = false;
     struct CmdArgs args = {0};
 
     Logger("runc start prestart-hook ...", LEVEL_INFO, SCREEN_YES);
-    while ((c = getopt_long(argc, argv, "l:p:r:o:f:i", g_cmdOpts, NULL)) != -1) {
+    while ((c = getopt_long(argc, argv, "l:p:r:o:f:is:P", g_cmdOpts, NULL)) != -1) {
+        if (c == 'P') {
+            prestart = true;
+            continue;
+        }
+        // 挂载项之外的参数在prestart模式下取自容器state
+        containerArgs = containerArgs || (c != 'f' && c != 'i');
         ret = ParseOneCmdArg(&args, (char)c, optarg);
         if (ret < 0) {
             Logger("failed to parse cmd args.", LEVEL_ERROR, SCREEN_YES);
             return -1;
         }
     }
+    if (prestart) {
+        ret = (!containerArgs && optind == argc) ? ParsePrestartArgs(&args) : -1;
+        if (ret == PRESTART_NO_DEVICE) {
+            return 0;
+        }
+        if (ret < 0) {
+            Logger("failed to parse prestart hook input.", LEVEL_ERROR, SCREEN_YES);
+            return -1;
+        }
+    }
     Logger("verify parameters valid and parse runtime options", LEVEL_INFO, SCREEN_YES);
     if (!IsCmdArgsValid(&args)) {
         Logger("information not completed or valid.", LEVEL_ERROR, SCREEN_YES);
         return -1;
     }
 
-    ParseRuntimeOptions(args.options);
-    Logger("setup container config ...", LEVEL_INFO, SCREEN_YES);
-    ret = SetupContainer(&args);
-    if (ret < 0) {
-        Logger("failed to setup container.", LEVEL_ERROR, SCREEN_YES);
-        return ret;
+    if ((strlen(args.sourceFds) > 0) && (VerifyFdSources(&args) < 0)) {
+        Logger("failed to verify mount sources.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
     }
-    Logger("prestart-hook setup container successful.", LEVEL_INFO, SCREEN_YES);
-    return 0;
+
+    ParseRuntimeOptions(args.options);
+    return SetupTargets(&args);
 }
 
 #ifdef gtest
@@ -32,6 +32,15 @@ int GetNsPath(const long pid, const char *nsType, char *buf, const size_t bufSiz
     return sprintf_s(buf, bufSize, fmtStr, pid, nsType);
 }
 
+int GetMountInfoPath(const long pid, char *buf, const size_t bufSize)
+{
+    if (buf == NULL) {
+        return -1;
+    }
+    static const char *fmtStr = "/proc/%ld/mountinfo";
+    return sprintf_s(buf, bufSize, fmtStr, pid);
+}
+
 int GetSelfNsPath(const char *nsType, char *buf, const size_t bufSize)
 {
     if ((nsType == NULL) || (buf == NULL)) {
@@ -18,6 +18,7 @@
 #include <sys/types.h>
 
 int GetNsPath(const long pid, const char *nsType, char *buf, const size_t bufSize);
+int GetMountInfoPath(const long pid, char *buf, const size_t bufSize);
 int GetSelfNsPath(const char *nsType, char *buf, const size_t bufSize);
 int EnterNsByFd(int fd, int nsType);
 int EnterNsByPath(const char *path, int nsType);
@@ -0,0 +1,497 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2020-2022. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "oci.h"
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include "securec.h"
+
+#include "utils.h"
+#include "logger.h"
+
+#define JSON_MAX_DEPTH 64
+#define JSON_NUMBER_LEN 32
+#define JSON_LITERAL_LEN 8
+#define JSON_HEX_DIGITS 4
+#define JSON_HEX_BASE 16
+#define JSON_STRING_TRUNCATED 1
+#define OCI_CONFIG_MAX_SIZE_MB 100
+#define DECIMAL 10
+
+static const char *ENV_VISIBLE_DEVICES = "ASCEND_VISIBLE_DEVICES";
+static const char *ENV_RUNTIME_OPTIONS = "ASCEND_RUNTIME_OPTIONS";
+static const char *ENV_ALLOW_LINK = "ASCEND_ALLOW_LINK";
+
+// 边读边解析，只取需要的字段，其余值直接跳过不保存
+struct JsonReader {
+    FILE *stream;
+    unsigned int depth;
+};
+
+typedef int (*JsonMemberHandler)(struct JsonReader *reader, const char *key, void *ctx);
+typedef int (*JsonElementHandler)(struct JsonReader *reader, void *ctx);
+
+static int SkipValue(struct JsonReader *reader);
+
+static int PeekChar(struct JsonReader *reader)
+{
+    int c;
+    do {
+        c = getc(reader->stream);
+    } while ((c == ' ') || (c == '\t') || (c == '\n') || (c == '\r'));
+    if (c != EOF) {
+        (void)ungetc(c, reader->stream);
+    }
+    return c;
+}
+
+static bool ExpectChar(struct JsonReader *reader, char expected)
+{
+    return (PeekChar(reader) == expected) && (getc(reader->stream) == expected);
+}
+
+static int ReadHex4(struct JsonReader *reader, unsigned int *code)
+{
+    *code = 0;
+    for (int i = 0; i < JSON_HEX_DIGITS; i++) {
+        int c = getc(reader->stream);
+        if (!isxdigit(c)) {
+            return -1;
+        }
+        *code = *code * JSON_HEX_BASE + (unsigned int)(isdigit(c) ? (c - '0') : (tolower(c) - 'a' + DECIMAL));
+    }
+    return 0;
+}
+
+// \uXXXX转义按UTF-8写入，代理对合并为一个码点
+static int ReadEscapedCode(struct JsonReader *reader, unsigned int *code)
+{
+    static const unsigned int highSurrogate = 0xD800;
+    static const unsigned int lowSurrogate = 0xDC00;
+    static const unsigned int surrogateEnd = 0xE000;
+    static const unsigned int surrogateBits = 10;
+    static const unsigned int supplementaryBase = 0x10000;
+    if (ReadHex4(reader, code) < 0) {
+        return -1;
+    }
+    if ((*code >= lowSurrogate) && (*code < surrogateEnd)) {
+        return -1;
+    }
+    if ((*code < highSurrogate) || (*code >= lowSurrogate)) {
+        return 0;
+    }
+    unsigned int low = 0;
+    if ((getc(reader->stream) != '\\') || (getc(reader->stream) != 'u') || (ReadHex4(reader, &low) < 0) ||
+        (low < lowSurrogate) || (low >= surrogateEnd)) {
+        return -1;
+    }
+    *code = supplementaryBase + ((*code - highSurrogate) << surrogateBits) + (low - lowSurrogate);
+    return 0;
+}
+
+static bool AppendByte(char *buf, size_t size, size_t *len, unsigned int byte)
+{
+    if (*len + 1 >= size) {
+        return false;
+    }
+    buf[(*len)++] = (char)byte;
+    return true;
+}
+
+static bool AppendUtf8(char *buf, size_t size, size_t *len, unsigned int code)
+{
+    if (code < 0x80) {
+        return AppendByte(buf, size, len, code);
+    }
+    if (code < 0x800) {
+        return AppendByte(buf, size, len, 0xC0 | (code >> 6)) &&
+            AppendByte(buf, size, len, 0x80 | (code & 0x3F));
+    }
+    if (code < 0x10000) {
+        return AppendByte(buf, size, len, 0xE0 | (code >> 12)) &&
+            AppendByte(buf, size, len, 0x80 | ((code >> 6) & 0x3F)) &&
+            AppendByte(buf, size, len, 0x80 | (code & 0x3F));
+    }
+    return AppendByte(buf, size, len, 0xF0 | (code >> 18)) &&
+        AppendByte(buf, size, len, 0x80 | ((code >> 12) & 0x3F)) &&
+        AppendByte(buf, size, len, 0x80 | ((code >> 6) & 0x3F)) &&
+        AppendByte(buf, size, len, 0x80 | (code & 0x3F));
+}
+
+static bool ReadEscape(struct JsonReader *reader, unsigned int *code)
+{
+    int c = getc(reader->stream);
+    switch (c) {
+        case '"':
+        case '\\':
+        case '/':
+            *code = (unsigned int)c;
+            return true;
+        case 'b':
+            *code = '\b';
+            return true;
+        case 'f':
+            *code = '\f';
+            return true;
+        case 'n':
+            *code = '\n';
+            return true;
+        case 'r':
+            *code = '\r';
+            return true;
+        case 't':
+            *code = '\t';
+            return true;
+        case 'u':
+            return ReadEscapedCode(reader, code) == 0;
+        default:
+            return false;
+    }
+}
+
+// buf为NULL时只跳过该字符串；超出buf时读完整个字符串并返回JSON_STRING_TRUNCATED
+static int ReadString(struct JsonReader *reader, char *buf, size_t size)
+{
+    if (!ExpectChar(reader, '"')) {
+        return -1;
+    }
+    size_t len = 0;
+    bool truncated = false;
+    for (;;) {
+        int c = getc(reader->stream);
+        if ((c == EOF) || ((unsigned int)c < 0x20)) {
+            return -1;
+        }
+        if (c == '"') {
+            break;
+        }
+        unsigned int code = (unsigned int)c;
+        bool escaped = (c == '\\');
+        if (escaped && !ReadEscape(reader, &code)) {
+            return -1;
+        }
+        if ((buf != NULL) && !truncated) {
+            truncated = escaped ? !AppendUtf8(buf, size, &len, code) : !AppendByte(buf, size, &len, code);
+        }
+    }
+    if (buf != NULL) {
+        buf[len] = '\0';
+    }
+    return truncated ? JSON_STRING_TRUNCATED : 0;
+}
+
+static int ReadNumber(struct JsonReader *reader, long *value)
+{
+    char buf[JSON_NUMBER_LEN] = {0};
+    size_t len = 0;
+    int c = PeekChar(reader);
+    while ((c != EOF) && (isdigit(c) || (strchr("+-.eE", c) != NULL))) {
+        if (len + 1 >= sizeof(buf)) {
+            return -1;
+        }
+        buf[len++] = (char)getc(reader->stream);
+        c = getc(reader->stream);
+        if (c != EOF) {
+            (void)ungetc(c, reader->stream);
+        }
+    }
+    if (len == 0) {
+        return -1;
+    }
+    if (value == NULL) {
+        return 0;
+    }
+    char *end = NULL;
+    errno = 0;
+    *value = strtol(buf, &end, DECIMAL);
+    return ((errno != 0) || (end == NULL) || (*end != '\0')) ? -1 : 0;
+}
+
+static int ReadLiteral(struct JsonReader *reader)
+{
+    char buf[JSON_LITERAL_LEN] = {0};
+    size_t len = 0;
+    int c = PeekChar(reader);
+    while ((c != EOF) && islower(c) && (len + 1 < sizeof(buf))) {
+        buf[len++] = (char)getc(reader->stream);
+        c = getc(reader->stream);
+        if (c != EOF) {
+            (void)ungetc(c, reader->stream);
+        }
+    }
+    return ((strcmp(buf, "true") == 0) || (strcmp(buf, "false") == 0) || (strcmp(buf, "null") == 0)) ? 0 : -1;
+}
+
+// handler须消费成员的值，handler为NULL时跳过全部成员
+static int ReadObject(struct JsonReader *reader, JsonMemberHandler handler, void *ctx)
+{
+    if ((reader->depth >= JSON_MAX_DEPTH) || !ExpectChar(reader, '{')) {
+        return -1;
+    }
+    reader->depth++;
+    if (PeekChar(reader) == '}') {
+        (void)getc(reader->stream);
+        reader->depth--;
+        return 0;
+    }
+    for (;;) {
+        char key[BUF_SIZE] = {0};
+        int ret = ReadString(reader, key, sizeof(key));
+        if ((ret < 0) || !ExpectChar(reader, ':')) {
+            return -1;
+        }
+        // 超长的键不会是关注的字段
+        ret = ((handler != NULL) && (ret != JSON_STRING_TRUNCATED)) ? handler(reader, key, ctx) : SkipValue(reader);
+        if (ret < 0) {
+            return -1;
+        }
+        int c = PeekChar(reader);
+        (void)getc(reader->stream);
+        if (c == '}') {
+            break;
+        }
+        if (c != ',') {
+            return -1;
+        }
+    }
+    reader->depth--;
+    return 0;
+}
+
+static int ReadArray(struct JsonReader *reader, JsonElementHandler handler, void *ctx)
+{
+    if ((reader->depth >= JSON_MAX_DEPTH) || !ExpectChar(reader, '[')) {
+        return -1;
+    }
+    reader->depth++;
+    if (PeekChar(reader) == ']') {
+        (void)getc(reader->stream);
+        reader->depth--;
+        return 0;
+    }
+    for (;;) {
+        int ret = (handler != NULL) ? handler(reader, ctx) : SkipValue(reader);
+        if (ret < 0) {
+            return -1;
+        }
+        int c = PeekChar(reader);
+        (void)getc(reader->stream);
+        if (c == ']') {
+            break;
+        }
+        if (c != ',') {
+            return -1;
+        }
+    }
+    reader->depth--;
+    return 0;
+}
+
+static int SkipValue(struct JsonReader *reader)
+{
+    int c = PeekChar(reader);
+    if (c == '{') {
+        return ReadObject(reader, NULL, NULL);
+    }
+    if (c == '[') {
+        return ReadArray(reader, NULL, NULL);
+    }
+    if (c == '"') {
+        return (ReadString(reader, NULL, 0) < 0) ? -1 : 0;
+    }
+    if (islower(c)) {
+        return ReadLiteral(reader);
+    }
+    return ReadNumber(reader, NULL);
+}
+
+static int ReadStringValue(struct JsonReader *reader, char *buf, size_t size)
+{
+    return (ReadString(reader, buf, size) == 0) ? 0 : -1;
+}
+
+static int OnStateMember(struct JsonReader *reader, const char *key, void *ctx)
+{
+    struct OciHookInfo *info = (struct OciHookInfo *)ctx;
+    if (strcmp(key, "pid") == 0) {
+        return ReadNumber(reader, &info->pid);
+    }
+    if (strcmp(key, "bundle") == 0) {
+        return ReadStringValue(reader, info->bundle, sizeof(info->bundle));
+    }
+    return SkipValue(reader);
+}
+
+int ReadOciState(FILE *stream, struct OciHookInfo *info)
+{
+    if ((stream == NULL) || (info == NULL)) {
+        Logger("stream or info pointer is null!", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+
+    struct JsonReader reader = { .stream = stream, .depth = 0 };
+    info->pid = 0;
+    info->bundle[0] = '\0';
+    if (ReadObject(&reader, OnStateMember, info) < 0) {
+        Logger("failed to parse the container's state.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    if ((info->pid <= 0) || (strlen(info->bundle) == 0)) {
+        Logger("container's state lacks pid or bundle.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    return 0;
+}
+
+// 与hook一致，同名环境变量以第一个为准
+static int OnEnvElement(struct JsonReader *reader, void *ctx)
+{
+    static const struct {
+        const char **name;
+        size_t offset;
+    } envFields[] = {
+        {&ENV_VISIBLE_DEVICES, offsetof(struct OciHookInfo, visibleDevices)},
+        {&ENV_RUNTIME_OPTIONS, offsetof(struct OciHookInfo, runtimeOptions)},
+        {&ENV_ALLOW_LINK, offsetof(struct OciHookInfo, allowLink)},
+    };
+    struct OciHookInfo *info = (struct OciHookInfo *)ctx;
+    char env[BUF_SIZE] = {0};
+    int ret = ReadString(reader, env, sizeof(env));
+    if (ret < 0) {
+        return -1;
+    }
+    char *sep = strchr(env, '=');
+    if (sep == NULL) {
+        Logger("environment error.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    *sep = '\0';
+    for (size_t i = 0; i < sizeof(envFields) / sizeof(envFields[0]); i++) {
+        if (strcmp(env, *envFields[i].name) != 0) {
+            continue;
+        }
+        char *field = (char *)info + envFields[i].offset;
+        if (ret == JSON_STRING_TRUNCATED) {
+            char* str = FormatLogMessage("environment %s is too long.", env);
+            Logger(str, LEVEL_ERROR, SCREEN_YES);
+            free(str);
+            return -1;
+        }
+        if ((field[0] == '\0') && (strcpy_s(field, BUF_SIZE, sep + 1) != EOK)) {
+            return -1;
+        }
+        break;
+    }
+    return 0;
+}
+
+static int OnProcessMember(struct JsonReader *reader, const char *key, void *ctx)
+{
+    if (strcmp(key, "env") == 0) {
+        return (PeekChar(reader) == 'n') ? ReadLiteral(reader) : ReadArray(reader, OnEnvElement, ctx);
+    }
+    return SkipValue(reader);
+}
+
+static int OnRootMember(struct JsonReader *reader, const char *key, void *ctx)
+{
+    struct OciHookInfo *info = (struct OciHookInfo *)ctx;
+    if (strcmp(key, "path") == 0) {
+        return ReadStringValue(reader, info->rootfs, sizeof(info->rootfs));
+    }
+    return SkipValue(reader);
+}
+
+struct OciConfigContext {
+    struct OciHookInfo *info;
+    bool hasRoot;
+    bool hasProcess;
+};
+
+static int OnConfigMember(struct JsonReader *reader, const char *key, void *ctx)
+{
+    struct OciConfigContext *config = (struct OciConfigContext *)ctx;
+    if (strcmp(key, "root") == 0) {
+        config->hasRoot = true;
+        return ReadObject(reader, OnRootMember, config->info);
+    }
+    if (strcmp(key, "process") == 0) {
+        config->hasProcess = true;
+        return ReadObject(reader, OnProcessMember, config->info);
+    }
+    return SkipValue(reader);
+}
+
+// 使用ctr启动时config.json中的rootfs为相对bundle的路径
+static int ResolveRootfs(struct OciHookInfo *info)
+{
+    if (info->rootfs[0] == '/') {
+        return 0;
+    }
+    char rootfs[PATH_MAX] = {0};
+    const char *relative = (strncmp(info->rootfs, "./", strlen("./")) == 0) ? info->rootfs + strlen("./") :
+        info->rootfs;
+    int ret = (strlen(relative) == 0) ? sprintf_s(rootfs, PATH_MAX, "%s", info->bundle) :
+        sprintf_s(rootfs, PATH_MAX, "%s/%s", info->bundle, relative);
+    if ((ret < 0) || (strcpy_s(info->rootfs, PATH_MAX, rootfs) != EOK)) {
+        Logger("failed to assemble rootfs path.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    return 0;
+}
+
+int ReadOciConfig(struct OciHookInfo *info)
+{
+    if (info == NULL) {
+        Logger("info pointer is null!", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+
+    char configPath[PATH_MAX] = {0};
+    if (sprintf_s(configPath, PATH_MAX, "%s/config.json", info->bundle) < 0) {
+        Logger("failed to assemble OCI config path.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    if (!CheckExternalFile(configPath, strlen(configPath), OCI_CONFIG_MAX_SIZE_MB, true)) {
+        Logger("failed to check OCI config file.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    FILE *stream = fopen(configPath, "r");
+    if (stream == NULL) {
+        Logger("failed to open OCI config file.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+
+    struct JsonReader reader = { .stream = stream, .depth = 0 };
+    struct OciConfigContext config = { .info = info, .hasRoot = false, .hasProcess = false };
+    info->rootfs[0] = '\0';
+    info->visibleDevices[0] = '\0';
+    info->runtimeOptions[0] = '\0';
+    info->allowLink[0] = '\0';
+    int ret = ReadObject(&reader, OnConfigMember, &config);
+    (void)fclose(stream);
+    if (ret < 0) {
+        Logger("failed to parse OCI config file.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    if (!config.hasRoot || !config.hasProcess) {
+        Logger("invalid OCI spec for empty process or root.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    return ResolveRootfs(info);
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2020-2022. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _OCI_H
+#define _OCI_H
+
+#include <stdio.h>
+#include <limits.h>
+#include "basic.h"
+
+// prestart钩子所需的容器信息，取自runc传入的state与bundle下的config.json
+struct OciHookInfo {
+    long pid;
+    char bundle[PATH_MAX];
+    char rootfs[PATH_MAX];
+    char visibleDevices[BUF_SIZE];
+    char runtimeOptions[BUF_SIZE];
+    char allowLink[BUF_SIZE];
+};
+
+int ReadOciState(FILE *stream, struct OciHookInfo *info);
+int ReadOciConfig(struct OciHookInfo *info);
+
+#endif
@@ -21,6 +21,8 @@
 static struct {
     bool noDrv;
     bool isVirtual;
+    bool staging;
+    bool copyIn;
 } g_runtimeOptions;
 
 static struct {
@@ -29,9 +31,42 @@ static struct {
 } g_optionNameFlagTable[] = {
     {"NODRV", &g_runtimeOptions.noDrv}, // 不挂载Driver
     {"VIRTUAL", &g_runtimeOptions.isVirtual},
+    {"STAGING", &g_runtimeOptions.staging}, // 使用宿主机staging目录挂载Driver
+    {"COPYIN", &g_runtimeOptions.copyIn}, // 小配置文件拷贝进容器而非挂载
     {NULL, NULL}
 };
 
+static bool IsValidOptionName(const char *name)
+{
+    for (int i = 0; g_optionNameFlagTable[i].name != NULL; i++) {
+        if (strcmp(name, g_optionNameFlagTable[i].name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool IsValidRuntimeOptions(const char *options)
+{
+    if (options == NULL || strlen(options) == 0) {
+        return false;
+    }
+    char *runtimeOptions = strdup(options);
+    if (runtimeOptions == NULL) {
+        return false;
+    }
+    bool valid = true;
+    size_t tokenNr = 0;
+    char *context = NULL;
+    for (char *token = strtok_s(runtimeOptions, ",", &context); valid && token != NULL;
+        token = strtok_s(NULL, ",", &context)) {
+        valid = IsValidOptionName(token);
+        tokenNr++;
+    }
+    free(runtimeOptions);
+    return valid && tokenNr > 0;
+}
+
 void ParseRuntimeOptions(const char *options)
 {
     if (options == NULL) {
@@ -42,6 +77,8 @@ void ParseRuntimeOptions(const char *options)
     // set defaults value
     g_runtimeOptions.noDrv = false;
     g_runtimeOptions.isVirtual = false;
+    g_runtimeOptions.staging = false;
+    g_runtimeOptions.copyIn = false;
 
     static const char *seperator = ",";
     char *runtimeOptions = strdup(options);
@@ -74,3 +111,13 @@ bool IsVirtual()
 {
     return g_runtimeOptions.isVirtual;
 }
+
+bool IsOptionStagingSet()
+{
+    return g_runtimeOptions.staging;
+}
+
+bool IsOptionCopyInSet()
+{
+    return g_runtimeOptions.copyIn;
+}
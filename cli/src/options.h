@@ -20,5 +20,8 @@
 void ParseRuntimeOptions(const char *options);
 bool IsOptionNoDrvSet();
 bool IsVirtual();
+bool IsOptionStagingSet();
+bool IsOptionCopyInSet();
+bool IsValidRuntimeOptions(const char *options);
 
 #endif
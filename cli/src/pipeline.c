@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2020-2022. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define _GNU_SOURCE
+#include "pipeline.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include "securec.h"
+
+#include "basic.h"
+#include "ns.h"
+#include "u_mount.h"
+#include "utils.h"
+#include "logger.h"
+
+enum PipelineMsgKind {
+    PIPELINE_ENTRY_FILE = 0,
+    PIPELINE_ENTRY_DIR,
+    PIPELINE_END
+};
+
+// 每条消息对应一个已校验的挂载项，可附带一个游离挂载fd
+struct PipelineMsg {
+    unsigned int kind;
+    unsigned int index;
+    struct MountSource source;
+};
+
+static int SendEntry(int sock, const struct PipelineMsg *msg, int treeFd)
+{
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { .iov_base = (void *)msg, .iov_len = sizeof(*msg) };
+    struct msghdr hdr = {0};
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    if (treeFd >= 0) {
+        (void)memset_s(&control, sizeof(control), 0, sizeof(control));
+        hdr.msg_control = control.buf;
+        hdr.msg_controllen = sizeof(control.buf);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        if (memcpy_s(CMSG_DATA(cmsg), sizeof(int), &treeFd, sizeof(int)) != EOK) {
+            return -1;
+        }
+    }
+
+    ssize_t ret;
+    do {
+        ret = sendmsg(sock, &hdr, MSG_NOSIGNAL);
+    } while (ret < 0 && errno == EINTR);
+    return (ret == (ssize_t)sizeof(*msg)) ? 0 : -1;
+}
+
+static int RecvEntry(int sock, struct PipelineMsg *msg, int *treeFd)
+{
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { .iov_base = (void *)msg, .iov_len = sizeof(*msg) };
+    struct msghdr hdr = {0};
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control.buf;
+    hdr.msg_controllen = sizeof(control.buf);
+
+    *treeFd = -1;
+    ssize_t ret;
+    do {
+        ret = recvmsg(sock, &hdr, MSG_CMSG_CLOEXEC);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        return -1;
+    }
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+            cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+            (void)memcpy_s(treeFd, sizeof(int), CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+    // 对端提前关闭时读到0字节
+    if (ret != (ssize_t)sizeof(*msg) || (hdr.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) != 0) {
+        if (*treeFd >= 0) {
+            close(*treeFd);
+            *treeFd = -1;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+// 子进程：进入容器挂载命名空间后按到达顺序挂载，不需要再切回
+static int RunMountChild(int sock, struct ParsedConfig *config)
+{
+    if (EnterNsByPath((const char *)config->containerNsPath, CLONE_NEWNS) < 0) {
+        char* str = FormatLogMessage("failed to set to container ns: %s.", config->containerNsPath);
+        Logger(str, LEVEL_ERROR, SCREEN_YES);
+        free(str);
+        return -1;
+    }
+    config->rootfsFd = open((const char *)config->rootfs, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (config->rootfsFd < 0) {
+        Logger("failed to open rootfs.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+
+    BeginMounting(config->mountInfoPath);
+    int ret = 0;
+    struct PipelineMsg msg;
+    int treeFd = -1;
+    while (ret == 0) {
+        if (RecvEntry(sock, &msg, &treeFd) < 0) {
+            Logger("mount pipeline closed unexpectedly.", LEVEL_ERROR, SCREEN_YES);
+            ret = -1;
+            break;
+        }
+        if (msg.kind == PIPELINE_END) {
+            break;
+        }
+        const struct MountList *list = (msg.kind == PIPELINE_ENTRY_DIR) ? config->dirs : config->files;
+        if (msg.kind > PIPELINE_ENTRY_DIR || msg.index >= list->count) {
+            Logger("invalid mount pipeline entry.", LEVEL_ERROR, SCREEN_YES);
+            ret = -1;
+        } else {
+            ret = MountEntry(config->rootfsFd, (const char *)&list->list[msg.index][0], &msg.source, treeFd,
+                msg.kind == PIPELINE_ENTRY_DIR);
+        }
+        if (treeFd >= 0) {
+            close(treeFd);
+        }
+    }
+    EndMounting(ret == 0);
+    close(config->rootfsFd);
+    return ret;
+}
+
+// 父进程：在宿主机命名空间逐项校验，校验完一项即交给子进程挂载
+static int StreamEntries(int sock, struct MountList *list, unsigned int kind)
+{
+    for (unsigned int i = 0; i < list->count; i++) {
+        const char *path = (const char *)&list->list[i][0];
+        struct MountSource *source = &list->sources[i];
+        if (!EnsureMountSourceVerified(path, source)) {
+            return -1;
+        }
+        if (!source->verified) {
+            continue;
+        }
+
+        struct PipelineMsg msg = { .kind = kind, .index = i, .source = *source };
+        int treeFd = OpenMountTree(path, source);
+        int ret = SendEntry(sock, &msg, treeFd);
+        if (treeFd >= 0) {
+            close(treeFd);
+        }
+        if (ret < 0) {
+            Logger("failed to send mount entry to container.", LEVEL_ERROR, SCREEN_YES);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int DoPipelinedMounting(struct ParsedConfig *config, struct MountList *files, struct MountList *dirs)
+{
+    if (config == NULL || files == NULL || dirs == NULL) {
+        Logger("config, files or dirs pointer is null!", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+
+    int socks[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, socks) < 0) {
+        Logger("failed to create mount pipeline.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        Logger("failed to fork mount process.", LEVEL_ERROR, SCREEN_YES);
+        close(socks[0]);
+        close(socks[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(socks[0]);
+        int childRet = RunMountChild(socks[1], config);
+        close(socks[1]);
+        _exit((childRet < 0) ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    close(socks[1]);
+    int ret = StreamEntries(socks[0], files, PIPELINE_ENTRY_FILE);
+    if (ret == 0) {
+        ret = StreamEntries(socks[0], dirs, PIPELINE_ENTRY_DIR);
+    }
+    if (ret == 0) {
+        struct PipelineMsg end = { .kind = PIPELINE_END };
+        ret = SendEntry(socks[0], &end, -1);
+    }
+    close(socks[0]);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            Logger("failed to wait mount process.", LEVEL_ERROR, SCREEN_YES);
+            return -1;
+        }
+    }
+    if (ret < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2020-2022. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define _GNU_SOURCE
+#include "staging.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "securec.h"
+
+#include "basic.h"
+#include "utils.h"
+#include "u_mount.h"
+#include "logger.h"
+
+#define STAGING_LOCK_FILE  STAGING_ROOT "/.lock"
+#define STAGING_READY_FILE "ready"
+#define STAGING_DIR_MODE   0700
+#define STAGING_FILE_MODE  0600
+#define FINGERPRINT_PRIME  16777619U
+#define NFTW_MAX_FDS       16
+
+// staging目录以挂载源的路径与inode为指纹，驱动升级后inode变化即重建
+static unsigned int GetStagingFingerprint(const struct ParsedConfig *config)
+{
+    const struct MountList *lists[] = {config->files, config->dirs};
+    unsigned int fingerprint = 0;
+    char entry[BUF_SIZE + PATH_MAX] = {0};
+    for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+        for (unsigned int j = 0; j < lists[i]->count; j++) {
+            const struct MountSource *source = &lists[i]->sources[j];
+            if (!source->verified) {
+                continue;
+            }
+            if (sprintf_s(entry, sizeof(entry), "%s:%lu:%lu", &lists[i]->list[j][0],
+                (unsigned long)source->dev, (unsigned long)source->ino) < 0) {
+                continue;
+            }
+            fingerprint = (fingerprint ^ HashPath(entry)) * FINGERPRINT_PRIME;
+        }
+    }
+    return fingerprint;
+}
+
+static int GetStagingPath(const char *stagingDir, const char *name, char *buf, size_t bufSize)
+{
+    return sprintf_s(buf, bufSize, "%s/%s", stagingDir, name);
+}
+
+static int OpenStagingTree(const char *stagingDir)
+{
+    char treePath[BUF_SIZE] = {0};
+    if (GetStagingPath(stagingDir, STAGING_TREE_NAME, treePath, BUF_SIZE) < 0) {
+        return -1;
+    }
+    return open(treePath, O_PATH | O_DIRECTORY | O_CLOEXEC);
+}
+
+// 已标记完成的staging目录仍需逐项确认挂载未被卸载
+static bool IsStagingReady(const char *stagingDir, const struct ParsedConfig *config)
+{
+    char readyPath[BUF_SIZE] = {0};
+    if (GetStagingPath(stagingDir, STAGING_READY_FILE, readyPath, BUF_SIZE) < 0 || access(readyPath, F_OK) != 0) {
+        return false;
+    }
+    int treeFd = OpenStagingTree(stagingDir);
+    if (treeFd < 0) {
+        return false;
+    }
+    const struct MountList *lists[] = {config->files, config->dirs};
+    bool ready = true;
+    for (size_t i = 0; ready && i < sizeof(lists) / sizeof(lists[0]); i++) {
+        for (unsigned int j = 0; ready && j < lists[i]->count; j++) {
+            const struct MountSource *source = &lists[i]->sources[j];
+            if (!source->verified) {
+                continue;
+            }
+            struct stat entryStat;
+            int fd = OpenInRoot(treeFd, &lists[i]->list[j][0], O_PATH);
+            ready = (fd >= 0) && (fstat(fd, &entryStat) == 0) &&
+                (entryStat.st_dev == source->dev) && (entryStat.st_ino == source->ino);
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+    close(treeFd);
+    return ready;
+}
+
+static int RemoveStagingEntry(const char *path, const struct stat *sb, int typeflag, struct FTW *ftwbuf)
+{
+    (void)sb;
+    (void)typeflag;
+    if (ftwbuf->level == 0 || strcmp(path, STAGING_LOCK_FILE) == 0) {
+        return 0;
+    }
+    (void)remove(path); // 仍被挂载的条目会删除失败，保留即可
+    return 0;
+}
+
+// 卸载并删除全部旧的staging目录，FTW_MOUNT保证不会越过未卸载的挂载点
+static void CleanStaging(void)
+{
+    DetachMountsUnder(STAGING_ROOT);
+    (void)nftw(STAGING_ROOT, RemoveStagingEntry, NFTW_MAX_FDS, FTW_DEPTH | FTW_PHYS | FTW_MOUNT);
+}
+
+static int StageEntry(int treeFd, const char *path, const struct MountSource *source)
+{
+    int dstFd = (S_ISDIR(source->mode) != 0) ? MakeMountDirAt(treeFd, path, DEFAULT_DIR_MODE) :
+        MakeMountPointsAt(treeFd, path, source->mode);
+    if (dstFd < 0) {
+        return -1;
+    }
+    int srcFd = OpenVerifiedSource(path, source);
+    if (srcFd < 0) {
+        close(dstFd);
+        return -1;
+    }
+    int ret = Mount(srcFd, treeFd, path, dstFd);
+    close(srcFd);
+    close(dstFd);
+    return ret;
+}
+
+static int BuildStaging(const char *stagingDir, const struct ParsedConfig *config)
+{
+    CleanStaging();
+    char path[BUF_SIZE] = {0};
+    if (GetStagingPath(stagingDir, STAGING_TREE_NAME, path, BUF_SIZE) < 0 ||
+        MakeDirWithParent(path, STAGING_DIR_MODE) < 0) {
+        Logger("failed to make staging dir.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    int treeFd = OpenStagingTree(stagingDir);
+    if (treeFd < 0) {
+        Logger("failed to open staging dir.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+
+    const struct MountList *lists[] = {config->files, config->dirs};
+    int ret = 0;
+    ResetMountPointCache();
+    for (size_t i = 0; ret >= 0 && i < sizeof(lists) / sizeof(lists[0]); i++) {
+        for (unsigned int j = 0; ret >= 0 && j < lists[i]->count; j++) {
+            if (lists[i]->sources[j].verified) {
+                ret = StageEntry(treeFd, &lists[i]->list[j][0], &lists[i]->sources[j]);
+            }
+        }
+    }
+    ResetMountPointCache();
+    close(treeFd);
+    if (ret < 0) {
+        Logger("failed to stage mount entries.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+
+    if (GetStagingPath(stagingDir, STAGING_READY_FILE, path, BUF_SIZE) < 0) {
+        return -1;
+    }
+    int readyFd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC | O_NOFOLLOW, STAGING_FILE_MODE);
+    if (readyFd < 0) {
+        Logger("failed to mark staging dir ready.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    close(readyFd);
+    return 0;
+}
+
+// 在宿主机挂载命名空间中准备只读的staging目录，失败时由调用方回退为逐条目挂载
+int PrepareStaging(struct ParsedConfig *config)
+{
+    if (config == NULL) {
+        Logger("config pointer is null!", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+
+    config->stagingDir[0] = '\0';
+    if (MakeDirWithParent(STAGING_ROOT, STAGING_DIR_MODE) < 0) {
+        Logger("failed to make staging root.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    int lockFd = open(STAGING_LOCK_FILE, O_RDWR | O_CREAT | O_CLOEXEC | O_NOFOLLOW, STAGING_FILE_MODE);
+    if (lockFd < 0 || flock(lockFd, LOCK_EX) != 0) {
+        Logger("failed to lock staging root.", LEVEL_ERROR, SCREEN_YES);
+        if (lockFd >= 0) {
+            close(lockFd);
+        }
+        return -1;
+    }
+
+    char stagingDir[BUF_SIZE] = {0};
+    int ret = sprintf_s(stagingDir, BUF_SIZE, "%s/%08x", STAGING_ROOT, GetStagingFingerprint(config));
+    if (ret >= 0 && !IsStagingReady(stagingDir, config)) {
+        Logger("build staging dir for current driver.", LEVEL_INFO, SCREEN_YES);
+        ret = BuildStaging(stagingDir, config);
+    }
+    close(lockFd);
+    if (ret < 0) {
+        return -1;
+    }
+    return (strcpy_s(config->stagingDir, BUF_SIZE, stagingDir) == EOK) ? 0 : -1;
+}
@@ -12,35 +12,232 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#define _GNU_SOURCE
 #include "u_mount.h"
 
 #include <stdlib.h>
 #include <errno.h>
 #include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
 #include <sys/mount.h>
+#include <sys/statvfs.h>
+#include <sys/sysmacros.h>
+#include <sys/syscall.h>
 #include "securec.h"
 
 #include "basic.h"
 #include "utils.h"
 #include "options.h"
+#include "staging.h"
 #include "logger.h"
 
-static bool checkSrcFile(const char *src)
+#define MOUNT_INFO_TABLE_SIZE 4096 // 必须为2的幂
+#define MOUNT_INFO_DEV_FIELD 2
+#define MOUNT_INFO_DEV_PARTS 2
+#define MOUNT_INFO_POINT_FIELD 4
+#define MOUNT_INFO_OPTIONS_FIELD 5
+#define OCTAL_ESCAPE_LEN 4
+#define OCTAL_BASE 8
+#define STAGING_UNAVAILABLE 1
+#define COPY_IN_MAX_SIZE (64 * 1024) // 不超过该大小的普通文件拷贝进容器
+#define COPY_IN_NOT_APPLICABLE 1
+#define COPY_IN_TMP_PREFIX ".ascend-copy-"
+
+#ifndef SYS_open_tree
+#define SYS_open_tree 428
+#endif
+#ifndef SYS_move_mount
+#define SYS_move_mount 429
+#endif
+#ifndef OPEN_TREE_CLONE
+#define OPEN_TREE_CLONE 1
+#endif
+#ifndef MOVE_MOUNT_F_EMPTY_PATH
+#define MOVE_MOUNT_F_EMPTY_PATH 0x00000004
+#endif
+#ifndef MOVE_MOUNT_T_EMPTY_PATH
+#define MOVE_MOUNT_T_EMPTY_PATH 0x00000040
+#endif
+
+// 仅属于Ascend驱动的目录，staging模式下整体递归挂载
+static const char *g_stagingPrefixes[] = {
+    "/usr/local/Ascend/driver", "/usr/local/dcmi", "/home/data/miniD/driver", NULL
+};
+
+struct MountInfoEntry {
+    char *mountPoint;
+    dev_t dev;
+    bool readOnly;
+    bool noSuid;
+};
+
+// 容器挂载命名空间中已有的挂载点，按挂载点路径索引
+static struct {
+    unsigned int count;
+    struct MountInfoEntry entries[MOUNT_INFO_TABLE_SIZE];
+} g_mountInfo;
+
+static unsigned int g_skippedMounts = 0;
+static unsigned int g_copiedFiles = 0;
+
+// mountinfo中空格等字符以\ooo八进制转义
+static void UnescapeMountPoint(char *path)
 {
-    struct stat fileStat;
-    if (lstat(src, &fileStat) != 0) {
-        return -1; // 待挂载源文件不存在
+    char *dst = path;
+    for (char *src = path; *src != '\0'; dst++) {
+        if (src[0] == '\\' && src[1] >= '0' && src[1] <= '7' && src[2] >= '0' && src[2] <= '7' &&
+            src[3] >= '0' && src[3] <= '7') {
+            *dst = (char)(((src[1] - '0') * OCTAL_BASE + (src[2] - '0')) * OCTAL_BASE + (src[3] - '0'));
+            src += OCTAL_ESCAPE_LEN;
+        } else {
+            *dst = *src++;
+        }
     }
-    if ((S_ISREG(fileStat.st_mode) != 0) || (S_ISDIR(fileStat.st_mode) != 0)) { // 只校验文件和目录
-            const size_t maxFileSzieMb = 10 * 1024; // max 10 G
-            if (!CheckExternalFile(src, strlen(src), maxFileSzieMb, false)) {
-                char* str = FormatLogMessage("failed to mount src: %s.", src);
-                Logger(str, LEVEL_ERROR, SCREEN_YES);
-                return false;
-            }
+    *dst = '\0';
+}
+
+static void AddMountInfoEntry(const char *mountPoint, dev_t dev, const char *options)
+{
+    if (g_mountInfo.count >= MOUNT_INFO_TABLE_SIZE / 2) {
+        return;
+    }
+    unsigned int slot = HashPath(mountPoint) & (MOUNT_INFO_TABLE_SIZE - 1);
+    while (g_mountInfo.entries[slot].mountPoint != NULL) {
+        if (strcmp(g_mountInfo.entries[slot].mountPoint, mountPoint) == 0) {
+            break; // 同一挂载点被多次挂载时以最后（最上层）的为准
+        }
+        slot = (slot + 1) & (MOUNT_INFO_TABLE_SIZE - 1);
+    }
+    struct MountInfoEntry *entry = &g_mountInfo.entries[slot];
+    if (entry->mountPoint == NULL) {
+        entry->mountPoint = strdup(mountPoint);
+        if (entry->mountPoint == NULL) {
+            return;
+        }
+        g_mountInfo.count++;
+    }
+    entry->dev = dev;
+    entry->readOnly = false;
+    entry->noSuid = false;
+
+    char *optionsCopy = strdup(options);
+    if (optionsCopy == NULL) {
+        return;
+    }
+    char *context = NULL;
+    for (char *token = strtok_s(optionsCopy, ",", &context); token != NULL;
+        token = strtok_s(NULL, ",", &context)) {
+        if (strcmp(token, "ro") == 0) {
+            entry->readOnly = true;
+        } else if (strcmp(token, "nosuid") == 0) {
+            entry->noSuid = true;
+        }
     }
-    if (S_ISDIR(fileStat.st_mode) != 0) { // 目录则增加递归校验子集
+    free(optionsCopy);
+}
+
+static const struct MountInfoEntry *FindMountInfoEntry(const char *mountPoint)
+{
+    unsigned int slot = HashPath(mountPoint) & (MOUNT_INFO_TABLE_SIZE - 1);
+    for (unsigned int i = 0; i < MOUNT_INFO_TABLE_SIZE; i++) {
+        const struct MountInfoEntry *entry = &g_mountInfo.entries[(slot + i) & (MOUNT_INFO_TABLE_SIZE - 1)];
+        if (entry->mountPoint == NULL) {
+            return NULL;
+        }
+        if (strcmp(entry->mountPoint, mountPoint) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void ParseMountInfoLine(char *line)
+{
+    char *context = NULL;
+    char *fields[MOUNT_INFO_OPTIONS_FIELD + 1] = {NULL};
+    char *token = strtok_s(line, " \n", &context);
+    for (int i = 0; i <= MOUNT_INFO_OPTIONS_FIELD && token != NULL; i++) {
+        fields[i] = token;
+        token = strtok_s(NULL, " \n", &context);
+    }
+    if (fields[MOUNT_INFO_OPTIONS_FIELD] == NULL) {
+        return;
+    }
+    unsigned int major = 0;
+    unsigned int minor = 0;
+    if (sscanf_s(fields[MOUNT_INFO_DEV_FIELD], "%u:%u", &major, &minor) != MOUNT_INFO_DEV_PARTS) {
+        return;
+    }
+    UnescapeMountPoint(fields[MOUNT_INFO_POINT_FIELD]);
+    AddMountInfoEntry(fields[MOUNT_INFO_POINT_FIELD], makedev(major, minor), fields[MOUNT_INFO_OPTIONS_FIELD]);
+}
+
+int LoadMountInfo(const char *mountInfoPath)
+{
+    if (mountInfoPath == NULL) {
+        return -1;
+    }
+    FILE *fp = fopen(mountInfoPath, "r"); // proc接口，非外部输入
+    if (fp == NULL) {
+        return -1;
+    }
+    char *line = NULL;
+    size_t lineSize = 0;
+    while (getline(&line, &lineSize, fp) != -1) {
+        ParseMountInfoLine(line);
+    }
+    free(line);
+    (void)fclose(fp);
+    return (int)g_mountInfo.count;
+}
+
+void FreeMountInfo(void)
+{
+    for (unsigned int i = 0; i < MOUNT_INFO_TABLE_SIZE; i++) {
+        free(g_mountInfo.entries[i].mountPoint);
+        g_mountInfo.entries[i].mountPoint = NULL;
+    }
+    g_mountInfo.count = 0;
+}
+
+// 目标已是src的只读、nosuid绑定挂载时无需重复挂载
+static bool IsAlreadyMounted(const struct MountSource *source, int dstFd)
+{
+    if (g_mountInfo.count == 0) {
+        return false;
+    }
+    struct stat dstStat;
+    if (fstat(dstFd, &dstStat) != 0 || dstStat.st_dev != source->dev || dstStat.st_ino != source->ino) {
+        return false;
+    }
+    char fdPath[BUF_SIZE] = {0};
+    char mountPoint[PATH_MAX] = {0};
+    if (GetProcFdPath(dstFd, fdPath, BUF_SIZE) < 0) {
+        return false;
+    }
+    ssize_t len = readlink(fdPath, mountPoint, PATH_MAX - 1);
+    if (len < 0) {
+        return false;
+    }
+    mountPoint[len] = '\0';
+    const struct MountInfoEntry *entry = FindMountInfoEntry(mountPoint);
+    return (entry != NULL) && (entry->dev == source->dev) && entry->readOnly && entry->noSuid;
+}
+
+static bool CheckMountSource(const char *src, mode_t mode)
+{
+    if ((S_ISREG(mode) != 0) || (S_ISDIR(mode) != 0)) { // 只校验文件和目录
+        const size_t maxFileSzieMb = 10 * 1024; // max 10 G
+        if (!CheckExternalFile(src, strlen(src), maxFileSzieMb, false)) {
+            char* str = FormatLogMessage("failed to mount src: %s.", src);
+            Logger(str, LEVEL_ERROR, SCREEN_YES);
+            free(str);
+            return false;
+        }
+    }
+    if (S_ISDIR(mode) != 0) { // 目录则增加递归校验子集
         if (!GetFileSubsetAndCheck(src, strlen(src))) {
             char* str = FormatLogMessage("Check file subset failed: %s.", src);
             Logger(str, LEVEL_ERROR, SCREEN_YES);
@@ -51,116 +248,394 @@ static bool checkSrcFile(const char *src)
     return true;
 }
 
-int Mount(const char *src, const char *dst)
+static int OpenMountSource(const char *src)
+{
+    int flags = O_PATH | O_CLOEXEC;
+    if (!g_allowLink) {
+        flags |= O_NOFOLLOW;
+    }
+    return open(src, flags);
+}
+
+// 解析阶段完成全部校验并记录源的身份，挂载阶段不再重复校验
+bool VerifyMountSource(const char *src, struct MountSource *source)
 {
-    if (src == NULL || dst == NULL) {
-        Logger("src pointer or dst pointer is null!", LEVEL_ERROR, SCREEN_YES);
+    if (src == NULL || source == NULL) {
+        Logger("src pointer or source pointer is null!", LEVEL_ERROR, SCREEN_YES);
+        return false;
+    }
+
+    source->checked = false;
+    source->verified = false;
+    int fd = OpenMountSource(src);
+    if (fd < 0) {
+        source->checked = (errno == ENOENT); // 源不存在时挂载阶段跳过
+        return source->checked;
+    }
+    struct stat srcStat;
+    int ret = fstat(fd, &srcStat);
+    close(fd);
+    if (ret != 0 || !CheckMountSource(src, srcStat.st_mode)) {
+        return false;
+    }
+
+    source->dev = srcStat.st_dev;
+    source->ino = srcStat.st_ino;
+    source->mode = srcStat.st_mode;
+    source->checked = true;
+    source->verified = true;
+    return true;
+}
+
+// hook已按fd完成父目录及子目录校验，这里确认fd与路径为同一对象并校验其自身权限
+bool VerifyMountSourceFd(const char *src, int fd, struct MountSource *source)
+{
+    if (src == NULL || source == NULL) {
+        Logger("src pointer or source pointer is null!", LEVEL_ERROR, SCREEN_YES);
+        return false;
+    }
+
+    source->checked = false;
+    source->verified = false;
+    struct stat srcStat;
+    if (fstat(fd, &srcStat) != 0) {
+        Logger("failed to stat source fd.", LEVEL_ERROR, SCREEN_YES);
+        return false;
+    }
+    char fdPath[BUF_SIZE] = {0};
+    char linkPath[PATH_MAX] = {0};
+    ssize_t len = -1;
+    if (GetProcFdPath(fd, fdPath, BUF_SIZE) >= 0) {
+        len = readlink(fdPath, linkPath, PATH_MAX - 1);
+    }
+    if (len < 0) {
+        Logger("failed to read source fd path.", LEVEL_ERROR, SCREEN_YES);
+        return false;
+    }
+    linkPath[len] = '\0';
+    struct stat pathStat;
+    if ((strcmp(linkPath, src) != 0) && // 允许软链接时fd指向链接目标
+        (stat(src, &pathStat) != 0 || pathStat.st_dev != srcStat.st_dev || pathStat.st_ino != srcStat.st_ino)) {
+        char* str = FormatLogMessage("source fd does not match mount src: %s.", src);
+        Logger(str, LEVEL_ERROR, SCREEN_YES);
+        free(str);
+        return false;
+    }
+    const unsigned long long maxFileSzieB = 10ULL * 1024 * 1024 * 1024; // max 10 G
+    if (((S_ISREG(srcStat.st_mode) == 0) && (S_ISDIR(srcStat.st_mode) == 0)) ||
+        ((srcStat.st_mode & (S_IWGRP | S_IWOTH)) != 0) ||
+        (S_ISREG(srcStat.st_mode) != 0 && (unsigned long long)srcStat.st_size >= maxFileSzieB)) {
+        char* str = FormatLogMessage("failed to mount src: %s.", src);
+        Logger(str, LEVEL_ERROR, SCREEN_YES);
+        free(str);
+        return false;
+    }
+
+    source->dev = srcStat.st_dev;
+    source->ino = srcStat.st_ino;
+    source->mode = srcStat.st_mode;
+    source->checked = true;
+    source->verified = true;
+    return true;
+}
+
+// 多个容器共用同一份挂载列表，已校验的源不再重复校验
+bool EnsureMountSourceVerified(const char *src, struct MountSource *source)
+{
+    if (source != NULL && source->checked) {
+        return true;
+    }
+    return VerifyMountSource(src, source);
+}
+
+// 容器挂载命名空间中重新打开源，只需比对身份即可
+int OpenVerifiedSource(const char *src, const struct MountSource *source)
+{
+    int fd = OpenMountSource(src);
+    if (fd < 0) {
+        char* str = FormatLogMessage("failed to open mount src: %s.", src);
+        Logger(str, LEVEL_ERROR, SCREEN_YES);
+        free(str);
+        return -1;
+    }
+    struct stat srcStat;
+    if (fstat(fd, &srcStat) != 0 || srcStat.st_dev != source->dev || srcStat.st_ino != source->ino) {
+        char* str = FormatLogMessage("mount src changed after verification: %s.", src);
+        Logger(str, LEVEL_ERROR, SCREEN_YES);
+        free(str);
+        close(fd);
         return -1;
     }
+    return fd;
+}
 
-    static const unsigned long mountFlags = MS_BIND;
-    static const unsigned long remountFlags = MS_BIND | MS_REMOUNT | MS_RDONLY | MS_NOSUID;
-    if (!checkSrcFile(src)) {
+// 在宿主机命名空间将源克隆为游离挂载，该fd可传入其他挂载命名空间直接接入
+int OpenMountTree(const char *src, const struct MountSource *source)
+{
+    static bool unsupported = false;
+    if (src == NULL || source == NULL || unsupported) {
         return -1;
     }
-    int ret = mount(src, dst, NULL, mountFlags, NULL);
-    if (ret < 0) {
-        Logger("failed to mount src.", LEVEL_ERROR, SCREEN_YES);
+
+    unsigned int flags = OPEN_TREE_CLONE | O_CLOEXEC;
+    if (!g_allowLink) {
+        flags |= AT_SYMLINK_NOFOLLOW;
+    }
+    int fd = (int)syscall(SYS_open_tree, AT_FDCWD, src, flags);
+    if (fd < 0) {
+        unsupported = (errno == ENOSYS); // 低版本内核退回按路径挂载
         return -1;
     }
+    struct stat srcStat;
+    if (fstat(fd, &srcStat) != 0 || srcStat.st_dev != source->dev || srcStat.st_ino != source->ino) {
+        char* str = FormatLogMessage("mount src changed after verification: %s.", src);
+        Logger(str, LEVEL_WARN, SCREEN_YES);
+        free(str);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
 
-    ret = mount(NULL, dst, NULL, remountFlags, NULL);
+// dstFd仍指向被覆盖的挂载点，需重新解析到新挂载的根再remount
+static int RemountReadOnly(int rootfsFd, const char *dst)
+{
+    static const unsigned long remountFlags = MS_BIND | MS_REMOUNT | MS_RDONLY | MS_NOSUID;
+    char target[BUF_SIZE] = {0};
+    int mountedFd = OpenInRoot(rootfsFd, dst, O_PATH);
+    if (mountedFd < 0) {
+        Logger("failed to resolve mounted dst.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    int ret = GetProcFdPath(mountedFd, target, BUF_SIZE);
+    if (ret >= 0) {
+        ret = mount(NULL, target, NULL, remountFlags, NULL);
+    }
+    close(mountedFd);
     if (ret < 0) {
         Logger("failed to re-mount. dst.", LEVEL_ERROR, SCREEN_YES);
         return -1;
     }
-
     return 0;
 }
 
-int MountFile(const char *rootfs, const char *filepath)
+static int BindMount(int srcFd, int rootfsFd, const char *dst, int dstFd, unsigned long mountFlags)
 {
-    if (rootfs == NULL || filepath == NULL) {
-        Logger("rootfs, filepath pointer is null!", LEVEL_ERROR, SCREEN_YES);
+    if (dst == NULL) {
+        Logger("dst pointer is null!", LEVEL_ERROR, SCREEN_YES);
         return -1;
     }
 
-    int ret;
-    char dst[BUF_SIZE] = {0};
-
-    ret = sprintf_s(dst, BUF_SIZE, "%s%s", rootfs, filepath);
-    if (ret < 0) {
-        Logger("failed to assemble file mounting path.", LEVEL_ERROR, SCREEN_YES);
+    char source[BUF_SIZE] = {0};
+    char target[BUF_SIZE] = {0};
+    if (GetProcFdPath(srcFd, source, BUF_SIZE) < 0 || GetProcFdPath(dstFd, target, BUF_SIZE) < 0) {
+        Logger("failed to assemble mount src or target.", LEVEL_ERROR, SCREEN_YES);
         return -1;
     }
-
-    struct stat srcStat;
-    ret = stat(filepath, &srcStat);
+    int ret = mount(source, target, NULL, mountFlags, NULL);
     if (ret < 0) {
-        return 0;
+        Logger("failed to mount src.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
     }
 
-    ret = MakeMountPoints(dst, srcStat.st_mode);
-    if (ret < 0) {
-        Logger("failed to create mount dst file.", LEVEL_ERROR, SCREEN_YES);
+    return RemountReadOnly(rootfsFd, dst);
+}
+
+// 将宿主机侧克隆的游离挂载接入容器内挂载点
+static int AttachMountTree(int treeFd, int rootfsFd, const char *dst, int dstFd)
+{
+    if (syscall(SYS_move_mount, treeFd, "", dstFd, "", MOVE_MOUNT_F_EMPTY_PATH | MOVE_MOUNT_T_EMPTY_PATH) < 0) {
+        Logger("failed to attach mount tree.", LEVEL_ERROR, SCREEN_YES);
         return -1;
     }
 
-    ret = Mount(filepath, dst);
-    if (ret < 0) {
-        Logger("failed to mount dev.", LEVEL_ERROR, SCREEN_YES);
+    return RemountReadOnly(rootfsFd, dst);
+}
+
+int Mount(int srcFd, int rootfsFd, const char *dst, int dstFd)
+{
+    return BindMount(srcFd, rootfsFd, dst, dstFd, MS_BIND);
+}
+
+int MountRecursive(int srcFd, int rootfsFd, const char *dst, int dstFd)
+{
+    return BindMount(srcFd, rootfsFd, dst, dstFd, MS_BIND | MS_REC);
+}
+
+static int OpenSourceForRead(const char *path, const struct MountSource *source, struct stat *srcStat)
+{
+    int srcFd = OpenVerifiedSource(path, source);
+    if (srcFd < 0) {
+        return -1;
+    }
+    char srcPath[BUF_SIZE] = {0};
+    int readFd = -1;
+    if (GetProcFdPath(srcFd, srcPath, BUF_SIZE) >= 0) {
+        readFd = open(srcPath, O_RDONLY | O_CLOEXEC);
+    }
+    close(srcFd);
+    if (readFd >= 0 && fstat(readFd, srcStat) != 0) {
+        close(readFd);
         return -1;
     }
+    return readFd;
+}
 
+// 先写入同目录临时文件再rename，容器内不会看到写了一半的文件
+static int CopyIntoParent(int readFd, const struct stat *srcStat, int parentFd, const char *name)
+{
+    char tmpName[PATH_MAX] = {0};
+    if (sprintf_s(tmpName, PATH_MAX, "%s%s", COPY_IN_TMP_PREFIX, name) < 0) {
+        return -1;
+    }
+    (void)unlinkat(parentFd, tmpName, 0);
+    int tmpFd = openat(parentFd, tmpName, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (tmpFd < 0) {
+        return -1;
+    }
+    int ret = CopyFileContent(readFd, tmpFd, srcStat->st_size);
+    if (ret == 0) {
+        ret = fchmod(tmpFd, srcStat->st_mode & (S_IRUSR | S_IRGRP | S_IROTH)); // 只保留读权限
+    }
+    close(tmpFd);
+    if (ret == 0) {
+        ret = renameat(parentFd, tmpName, parentFd, name);
+    }
+    if (ret != 0) {
+        (void)unlinkat(parentFd, tmpName, 0);
+        return -1;
+    }
     return 0;
 }
 
-int MountDir(const char *rootfs, const char *src)
+static int TryCopyFileIn(int rootfsFd, const char *path, const struct MountSource *source)
 {
-    if (rootfs == NULL || src == NULL) {
-        Logger("rootfs, src pointer is null!", LEVEL_ERROR, SCREEN_YES);
+    if (!IsOptionCopyInSet() || S_ISREG(source->mode) == 0) {
+        return COPY_IN_NOT_APPLICABLE;
+    }
+    struct stat srcStat;
+    int readFd = OpenSourceForRead(path, source, &srcStat);
+    if (readFd < 0) {
+        Logger("failed to open copy-in src.", LEVEL_ERROR, SCREEN_YES);
         return -1;
     }
+    if (srcStat.st_size > COPY_IN_MAX_SIZE) {
+        close(readFd);
+        return COPY_IN_NOT_APPLICABLE;
+    }
 
-    int ret;
-    char dst[BUF_SIZE] = {0};
+    // 之前已挂载过的目标保持不变
+    int dstFd = OpenInRoot(rootfsFd, path, O_PATH);
+    if (dstFd >= 0) {
+        bool mounted = IsAlreadyMounted(source, dstFd);
+        close(dstFd);
+        if (mounted) {
+            g_skippedMounts++;
+            close(readFd);
+            return 0;
+        }
+    }
 
-    ret = sprintf_s(dst, BUF_SIZE, "%s%s", rootfs, src);
+    char parent[BUF_SIZE] = {0};
+    const char *name = strrchr(path, '/');
+    int parentFd = -1;
+    if (name != NULL && GetParentPathStr(path, parent, BUF_SIZE) == 0 &&
+        MakeDirWithParentAt(rootfsFd, parent, DEFAULT_DIR_MODE) == 0) {
+        parentFd = OpenInRoot(rootfsFd, (strlen(parent) > 0) ? parent : "/", O_PATH | O_DIRECTORY);
+    }
+    int ret = (parentFd >= 0) ? CopyIntoParent(readFd, &srcStat, parentFd, name + 1) : -1;
+    if (parentFd >= 0) {
+        close(parentFd);
+    }
+    close(readFd);
     if (ret < 0) {
+        char* str = FormatLogMessage("failed to copy file into container: %s.", path);
+        Logger(str, LEVEL_ERROR, SCREEN_YES);
+        free(str);
         return -1;
     }
+    g_copiedFiles++;
+    return 0;
+}
 
-    struct stat srcStat;
-    ret = stat(src, &srcStat);
-    if (ret < 0) {
+// treeFd为宿主机侧克隆的游离挂载，小于0时在当前命名空间按路径重新打开源
+int MountEntry(int rootfsFd, const char *path, const struct MountSource *source, int treeFd, bool isDir)
+{
+    if (path == NULL || source == NULL) {
+        Logger("path pointer or source pointer is null!", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    if (!source->verified) {
         return 0;
     }
+    int ret;
+    if (!isDir) {
+        ret = TryCopyFileIn(rootfsFd, path, source);
+        if (ret != COPY_IN_NOT_APPLICABLE) {
+            return ret;
+        }
+    }
 
-    ret = MakeDirWithParent(dst, DEFAULT_DIR_MODE);
-    if (ret < 0) {
-        Logger("failed to make dir.", LEVEL_ERROR, SCREEN_YES);
+    int dstFd = isDir ? MakeMountDirAt(rootfsFd, path, DEFAULT_DIR_MODE) :
+        MakeMountPointsAt(rootfsFd, path, source->mode);
+    if (dstFd < 0) {
+        Logger(isDir ? "failed to make dir." : "failed to create mount dst file.", LEVEL_ERROR, SCREEN_YES);
         return -1;
     }
+    if (IsAlreadyMounted(source, dstFd)) {
+        g_skippedMounts++;
+        close(dstFd);
+        return 0;
+    }
 
-    ret = Mount(src, dst);
+    if (treeFd >= 0) {
+        ret = AttachMountTree(treeFd, rootfsFd, path, dstFd);
+    } else {
+        int srcFd = OpenVerifiedSource(path, source);
+        if (srcFd < 0) {
+            close(dstFd);
+            return -1;
+        }
+        ret = Mount(srcFd, rootfsFd, path, dstFd);
+        close(srcFd);
+    }
+    close(dstFd);
     if (ret < 0) {
-        Logger("failed to mount dir", LEVEL_ERROR, SCREEN_YES);
+        Logger(isDir ? "failed to mount dir" : "failed to mount dev.", LEVEL_ERROR, SCREEN_YES);
         return -1;
     }
 
     return 0;
 }
 
-int DoDirectoryMounting(const char *rootfs, const struct MountList *list)
+int MountFile(int rootfsFd, const char *filepath, const struct MountSource *source)
 {
-    if (rootfs == NULL || list == NULL) {
-        Logger("rootfs, list pointer is null!", LEVEL_ERROR, SCREEN_YES);
+    if (filepath == NULL || source == NULL) {
+        Logger("filepath pointer or source pointer is null!", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    return MountEntry(rootfsFd, filepath, source, -1, false);
+}
+
+int MountDir(int rootfsFd, const char *src, const struct MountSource *source)
+{
+    if (src == NULL || source == NULL) {
+        Logger("src pointer or source pointer is null!", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    return MountEntry(rootfsFd, src, source, -1, true);
+}
+
+int DoDirectoryMounting(int rootfsFd, const struct MountList *list)
+{
+    if (list == NULL) {
+        Logger("list pointer is null!", LEVEL_ERROR, SCREEN_YES);
         return -1;
     }
 
     int ret;
     for (unsigned int i = 0; i < list->count; i++) {
-        ret = MountDir(rootfs, (const char *)&list->list[i][0]);
+        ret = MountDir(rootfsFd, (const char *)&list->list[i][0], &list->sources[i]);
         if (ret < 0) {
             Logger("failed to do directory mounting", LEVEL_ERROR, SCREEN_YES);
             return -1;
@@ -170,16 +645,16 @@ int DoDirectoryMounting(const char *rootfs, const struct MountList *list)
     return 0;
 }
 
-int DoFileMounting(const char *rootfs, const struct MountList *list)
+int DoFileMounting(int rootfsFd, const struct MountList *list)
 {
-    if (rootfs == NULL || list == NULL) {
-        Logger("rootfs, list pointer is null!", LEVEL_ERROR, SCREEN_YES);
+    if (list == NULL) {
+        Logger("list pointer is null!", LEVEL_ERROR, SCREEN_YES);
         return -1;
     }
 
     int ret;
     for (unsigned int i = 0; i < list->count; i++) {
-        ret = MountFile(rootfs, (const char *)&list->list[i][0]);
+        ret = MountFile(rootfsFd, (const char *)&list->list[i][0], &list->sources[i]);
         if (ret < 0) {
             Logger("failed to do file mounting for.", LEVEL_ERROR, SCREEN_YES);
             return -1;
@@ -189,6 +664,208 @@ int DoFileMounting(const char *rootfs, const struct MountList *list)
     return 0;
 }
 
+void DetachMountsUnder(const char *prefix)
+{
+    if (prefix == NULL || LoadMountInfo("/proc/self/mountinfo") < 0) {
+        return;
+    }
+    size_t prefixLen = strlen(prefix);
+    for (unsigned int i = 0; i < MOUNT_INFO_TABLE_SIZE; i++) {
+        const char *mountPoint = g_mountInfo.entries[i].mountPoint;
+        if (mountPoint != NULL && strncmp(mountPoint, prefix, prefixLen) == 0 && mountPoint[prefixLen] == '/') {
+            (void)umount2(mountPoint, MNT_DETACH); // 父挂载点先被卸载时子挂载点会一并卸载
+        }
+    }
+    FreeMountInfo();
+}
+
+static bool IsUnderPrefix(const char *path, const char *prefix)
+{
+    size_t prefixLen = strlen(prefix);
+    return strncmp(path, prefix, prefixLen) == 0 && (path[prefixLen] == '/' || path[prefixLen] == '\0');
+}
+
+static const char *GetStagingPrefix(const char *path)
+{
+    for (int i = 0; g_stagingPrefixes[i] != NULL; i++) {
+        if (IsUnderPrefix(path, g_stagingPrefixes[i])) {
+            return g_stagingPrefixes[i];
+        }
+    }
+    return NULL;
+}
+
+static int OpenStagingEntry(int treeFd, const char *path, struct MountSource *source)
+{
+    int fd = OpenInRoot(treeFd, path, O_PATH);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat entryStat;
+    if (fstat(fd, &entryStat) != 0 || entryStat.st_dev != source->dev || entryStat.st_ino != source->ino) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// staging中的条目已是只读、nosuid挂载，绑定挂载会继承这些属性，无需再remount
+static int MountStagingEntry(int treeFd, int rootfsFd, const char *path, struct MountSource *source)
+{
+    int srcFd = OpenStagingEntry(treeFd, path, source);
+    if (srcFd < 0) {
+        Logger("failed to open staging entry.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    int dstFd = (S_ISDIR(source->mode) != 0) ? MakeMountDirAt(rootfsFd, path, DEFAULT_DIR_MODE) :
+        MakeMountPointsAt(rootfsFd, path, source->mode);
+    if (dstFd < 0) {
+        Logger("failed to create staging mount dst.", LEVEL_ERROR, SCREEN_YES);
+        close(srcFd);
+        return -1;
+    }
+
+    int ret = 0;
+    struct statvfs srcVfs;
+    if (IsAlreadyMounted(source, dstFd)) {
+        g_skippedMounts++;
+    } else if (fstatvfs(srcFd, &srcVfs) == 0 && (srcVfs.f_flag & ST_RDONLY) != 0 && (srcVfs.f_flag & ST_NOSUID) != 0) {
+        char srcPath[BUF_SIZE] = {0};
+        char dstPath[BUF_SIZE] = {0};
+        if (GetProcFdPath(srcFd, srcPath, BUF_SIZE) < 0 || GetProcFdPath(dstFd, dstPath, BUF_SIZE) < 0) {
+            ret = -1;
+        } else {
+            ret = mount(srcPath, dstPath, NULL, MS_BIND, NULL);
+        }
+    } else {
+        ret = Mount(srcFd, rootfsFd, path, dstFd);
+    }
+    close(srcFd);
+    close(dstFd);
+    if (ret < 0) {
+        char* str = FormatLogMessage("failed to mount staging entry: %s.", path);
+        Logger(str, LEVEL_ERROR, SCREEN_YES);
+        free(str);
+        return -1;
+    }
+    return 0;
+}
+
+int MountStagingPrefix(int treeFd, int rootfsFd, const char *prefix)
+{
+    int srcFd = OpenInRoot(treeFd, prefix, O_PATH);
+    if (srcFd < 0) {
+        Logger("failed to open staging prefix.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    struct stat prefixStat;
+    int dstFd = -1;
+    if (fstat(srcFd, &prefixStat) != 0 || (dstFd = MakeMountDirAt(rootfsFd, prefix, DEFAULT_DIR_MODE)) < 0) {
+        Logger("failed to make staging prefix dir.", LEVEL_ERROR, SCREEN_YES);
+        close(srcFd);
+        return -1;
+    }
+
+    int ret = 0;
+    struct MountSource prefixSource = {
+        .checked = true, .verified = true,
+        .dev = prefixStat.st_dev, .ino = prefixStat.st_ino, .mode = prefixStat.st_mode
+    };
+    if (IsAlreadyMounted(&prefixSource, dstFd)) {
+        g_skippedMounts++;
+    } else {
+        ret = MountRecursive(srcFd, rootfsFd, prefix, dstFd);
+    }
+    close(srcFd);
+    close(dstFd);
+    if (ret < 0) {
+        char* str = FormatLogMessage("failed to mount staging prefix: %s.", prefix);
+        Logger(str, LEVEL_ERROR, SCREEN_YES);
+        free(str);
+        return -1;
+    }
+    return 0;
+}
+
+// 容器命名空间早于staging目录创建时其中看不到staging挂载，此时返回STAGING_UNAVAILABLE按条目挂载
+static bool IsStagingVisible(int treeFd, const struct MountList *lists[], size_t listsNr, bool prefixUsed[])
+{
+    for (size_t i = 0; i < listsNr; i++) {
+        for (unsigned int j = 0; j < lists[i]->count; j++) {
+            struct MountSource *source = (struct MountSource *)&lists[i]->sources[j];
+            if (!source->verified) {
+                continue;
+            }
+            int fd = OpenStagingEntry(treeFd, &lists[i]->list[j][0], source);
+            if (fd < 0) {
+                return false;
+            }
+            close(fd);
+            const char *prefix = GetStagingPrefix(&lists[i]->list[j][0]);
+            for (int k = 0; prefix != NULL && g_stagingPrefixes[k] != NULL; k++) {
+                prefixUsed[k] = prefixUsed[k] || (g_stagingPrefixes[k] == prefix);
+            }
+        }
+    }
+    return true;
+}
+
+static int DoStagingMounting(const struct ParsedConfig *config)
+{
+    char treePath[BUF_SIZE] = {0};
+    if (sprintf_s(treePath, BUF_SIZE, "%s/%s", config->stagingDir, STAGING_TREE_NAME) < 0) {
+        return STAGING_UNAVAILABLE;
+    }
+    int treeFd = open(treePath, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (treeFd < 0) {
+        return STAGING_UNAVAILABLE;
+    }
+
+    const struct MountList *lists[] = {config->files, config->dirs};
+    const size_t listsNr = sizeof(lists) / sizeof(lists[0]);
+    bool prefixUsed[sizeof(g_stagingPrefixes) / sizeof(g_stagingPrefixes[0])] = {false};
+    if (!IsStagingVisible(treeFd, lists, listsNr, prefixUsed)) {
+        close(treeFd);
+        return STAGING_UNAVAILABLE;
+    }
+
+    int ret = 0;
+    for (int i = 0; ret >= 0 && g_stagingPrefixes[i] != NULL; i++) {
+        if (prefixUsed[i]) {
+            ret = MountStagingPrefix(treeFd, config->rootfsFd, g_stagingPrefixes[i]);
+        }
+    }
+    for (size_t i = 0; ret >= 0 && i < listsNr; i++) {
+        for (unsigned int j = 0; ret >= 0 && j < lists[i]->count; j++) {
+            struct MountSource *source = (struct MountSource *)&lists[i]->sources[j];
+            if (!source->verified || GetStagingPrefix(&lists[i]->list[j][0]) != NULL) {
+                continue;
+            }
+            ret = TryCopyFileIn(config->rootfsFd, &lists[i]->list[j][0], source);
+            if (ret == COPY_IN_NOT_APPLICABLE) {
+                ret = MountStagingEntry(treeFd, config->rootfsFd, &lists[i]->list[j][0], source);
+            }
+        }
+    }
+    close(treeFd);
+    return ret;
+}
+
+static int DoEntryMounting(const struct ParsedConfig *config)
+{
+    int ret = DoFileMounting(config->rootfsFd, config->files);
+    if (ret < 0) {
+        Logger("failed to mount files.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    ret = DoDirectoryMounting(config->rootfsFd, config->dirs);
+    if (ret < 0) {
+        Logger("failed to do mount directories.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    return 0;
+}
+
 int DoMounting(const struct ParsedConfig *config)
 {
     if (config == NULL) {
@@ -202,17 +879,48 @@ int DoMounting(const struct ParsedConfig *config)
         return 0;
     }
 
-    ret = DoFileMounting(config->rootfs, config->files);
-    if (ret < 0) {
-        Logger("failed to mount files.", LEVEL_ERROR, SCREEN_YES);
-        return -1;
+    BeginMounting(config->mountInfoPath);
+    ret = STAGING_UNAVAILABLE;
+    if (strlen(config->stagingDir) > 0) {
+        ret = DoStagingMounting(config);
+        if (ret == STAGING_UNAVAILABLE) {
+            Logger("staging dir is not visible in container, mount entries one by one.", LEVEL_WARN, SCREEN_YES);
+        }
+    }
+    if (ret == STAGING_UNAVAILABLE) {
+        ret = DoEntryMounting(config);
     }
+    EndMounting(ret >= 0);
+    return (ret < 0) ? -1 : 0;
+}
 
-    ret = DoDirectoryMounting(config->rootfs, config->dirs);
-    if (ret < 0) {
-        Logger("failed to do mount directories.", LEVEL_ERROR, SCREEN_YES);
-        return -1;
+// 载入容器已有挂载并清空本轮统计，须在进入容器挂载命名空间后调用
+void BeginMounting(const char *mountInfoPath)
+{
+    if (mountInfoPath == NULL || LoadMountInfo(mountInfoPath) < 0) {
+        Logger("failed to read container mountinfo, will not skip existing mounts.", LEVEL_WARN, SCREEN_YES);
     }
+    g_skippedMounts = 0;
+    g_copiedFiles = 0;
+    ResetMountPointCache();
+}
 
-    return 0;
+void EndMounting(bool succeeded)
+{
+    ResetMountPointCache();
+    FreeMountInfo();
+    if (!succeeded) {
+        return;
+    }
+
+    if (g_copiedFiles > 0) {
+        char* str = FormatLogMessage("copied %u small files into container instead of mounting.", g_copiedFiles);
+        Logger(str, LEVEL_INFO, SCREEN_YES);
+        free(str);
+    }
+    if (g_skippedMounts > 0) {
+        char* str = FormatLogMessage("skipped %u mounts already present in container.", g_skippedMounts);
+        Logger(str, LEVEL_INFO, SCREEN_YES);
+        free(str);
+    }
 }
\ No newline at end of file
@@ -18,6 +18,19 @@
 #include <stdbool.h>
 #include "basic.h"
 
+bool VerifyMountSource(const char *src, struct MountSource *source);
+bool VerifyMountSourceFd(const char *src, int fd, struct MountSource *source);
+bool EnsureMountSourceVerified(const char *src, struct MountSource *source);
+int OpenVerifiedSource(const char *src, const struct MountSource *source);
+int OpenMountTree(const char *src, const struct MountSource *source);
+int Mount(int srcFd, int rootfsFd, const char *dst, int dstFd);
+int LoadMountInfo(const char *mountInfoPath);
+void FreeMountInfo(void);
+void DetachMountsUnder(const char *prefix);
+int MountEntry(int rootfsFd, const char *path, const struct MountSource *source, int treeFd, bool isDir);
+int MountStagingPrefix(int treeFd, int rootfsFd, const char *prefix);
+void BeginMounting(const char *mountInfoPath);
+void EndMounting(bool succeeded);
 int DoMounting(const struct ParsedConfig *config);
 bool DoMounting200RC(bool* is200Rc);
 
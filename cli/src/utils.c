@@ -12,6 +12,9 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 #include "utils.h"
 
 #include <stdio.h>
@@ -21,17 +24,43 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <libgen.h>
 #include <ctype.h>
 #include "securec.h"
 #include "logger.h"
 
 #define LOG_LENGTH 1024
+#define DIR_CACHE_SIZE 1024 // 必须为2的幂
+#define FNV_OFFSET_BASIS 2166136261U
+#define FNV_PRIME 16777619U
+#ifndef SYS_openat2
+#define SYS_openat2 437
+#endif
+#define RESOLVE_NO_MAGICLINKS_FLAG 0x02
+#define RESOLVE_IN_ROOT_FLAG 0x10
+#define FICLONE_REQUEST _IOW(0x94, 9, int) // 与linux/fs.h中FICLONE一致
+#define COPY_BUF_SIZE 65536
+
+// 与内核struct open_how布局一致，避免依赖新版本内核头文件
+struct OpenHow {
+    uint64_t flags;
+    uint64_t mode;
+    uint64_t resolve;
+};
 
 static bool g_checkWgroup = true;
+static bool g_openat2Unsupported = false;
 bool g_allowLink;
 
+// 单次运行内已创建或已确认存在的挂载点目录（相对rootfs）
+static struct {
+    unsigned int count;
+    char *paths[DIR_CACHE_SIZE];
+} g_dirCache;
+
 char *FormatLogMessage(char *format, ...)
 {
     if (format == NULL) {
@@ -194,6 +223,324 @@ int MakeMountPoints(const char *path, mode_t mode)
     return 0;
 }
 
+unsigned int HashPath(const char *path)
+{
+    unsigned int hash = FNV_OFFSET_BASIS;
+    for (const char *p = path; *p != '\0'; p++) {
+        hash ^= (unsigned char)*p;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static bool IsDirCached(const char *path)
+{
+    unsigned int slot = HashPath(path) & (DIR_CACHE_SIZE - 1);
+    for (unsigned int i = 0; i < DIR_CACHE_SIZE; i++) {
+        const char *cached = g_dirCache.paths[(slot + i) & (DIR_CACHE_SIZE - 1)];
+        if (cached == NULL) {
+            return false;
+        }
+        if (strcmp(cached, path) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void CacheDir(const char *path)
+{
+    if (g_dirCache.count >= DIR_CACHE_SIZE / 2) { // 缓存已满时不再记录，仅影响性能
+        return;
+    }
+    unsigned int slot = HashPath(path) & (DIR_CACHE_SIZE - 1);
+    while (g_dirCache.paths[slot] != NULL) {
+        if (strcmp(g_dirCache.paths[slot], path) == 0) {
+            return;
+        }
+        slot = (slot + 1) & (DIR_CACHE_SIZE - 1);
+    }
+    g_dirCache.paths[slot] = strdup(path);
+    if (g_dirCache.paths[slot] != NULL) {
+        g_dirCache.count++;
+    }
+}
+
+void ResetMountPointCache(void)
+{
+    for (unsigned int i = 0; i < DIR_CACHE_SIZE; i++) {
+        free(g_dirCache.paths[i]);
+        g_dirCache.paths[i] = NULL;
+    }
+    g_dirCache.count = 0;
+}
+
+static const char *TrimRootPrefix(const char *path)
+{
+    while (*path == '/') {
+        path++;
+    }
+    return path;
+}
+
+int GetProcFdPath(int fd, char *buf, size_t bufSize)
+{
+    return sprintf_s(buf, bufSize, "/proc/self/fd/%d", fd);
+}
+
+static int GetFdRealPath(int fd, char *buf, size_t bufSize)
+{
+    char fdPath[BUF_SIZE] = {0};
+    if (GetProcFdPath(fd, fdPath, BUF_SIZE) < 0) {
+        return -1;
+    }
+    ssize_t len = readlink(fdPath, buf, bufSize - 1);
+    if (len < 0) {
+        return -1;
+    }
+    buf[len] = '\0';
+    return 0;
+}
+
+static bool IsFdInsideRoot(int rootFd, int fd)
+{
+    char rootPath[PATH_MAX] = {0};
+    char realPath[PATH_MAX] = {0};
+    if (GetFdRealPath(rootFd, rootPath, PATH_MAX) < 0 || GetFdRealPath(fd, realPath, PATH_MAX) < 0) {
+        return false;
+    }
+    if (strcmp(rootPath, "/") == 0) {
+        return true;
+    }
+    size_t rootLen = strlen(rootPath);
+    return (strncmp(realPath, rootPath, rootLen) == 0) &&
+        (realPath[rootLen] == '\0' || realPath[rootLen] == '/');
+}
+
+// 以rootFd为根解析path（绝对符号链接与".."均不会越出rootfs），不支持O_CREAT
+int OpenInRoot(int rootFd, const char *path, int flags)
+{
+    if (path == NULL) {
+        (void)fprintf(stderr, "path pointer is null!\n");
+        return -1;
+    }
+
+    const char *relPath = TrimRootPrefix(path);
+    if (*relPath == '\0') {
+        relPath = ".";
+    }
+    if (!g_openat2Unsupported) {
+        struct OpenHow how = {
+            .flags = (uint64_t)(unsigned int)(flags | O_CLOEXEC),
+            .mode = 0,
+            .resolve = RESOLVE_IN_ROOT_FLAG | RESOLVE_NO_MAGICLINKS_FLAG,
+        };
+        int fd = (int)syscall(SYS_openat2, rootFd, relPath, &how, sizeof(how));
+        if (fd >= 0 || errno != ENOSYS) {
+            return fd;
+        }
+        g_openat2Unsupported = true;
+    }
+
+    // 低版本内核不支持openat2，打开后校验实际路径仍位于rootfs内
+    int fd = openat(rootFd, relPath, flags | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    if (!IsFdInsideRoot(rootFd, fd)) {
+        char* str = FormatLogMessage("path escapes from rootfs: %s.", path);
+        Logger(str, LEVEL_ERROR, SCREEN_YES);
+        free(str);
+        close(fd);
+        errno = EXDEV;
+        return -1;
+    }
+    return fd;
+}
+
+static int OpenParentInRoot(int rootFd, const char *relPath, const char **leaf)
+{
+    const char *sep = strrchr(relPath, '/');
+    if (sep == NULL) {
+        *leaf = relPath;
+        return dup(rootFd);
+    }
+    *leaf = sep + 1;
+
+    char parent[PATH_MAX] = {0};
+    if (strncpy_s(parent, PATH_MAX, relPath, (size_t)(sep - relPath)) != EOK) {
+        return -1;
+    }
+    return OpenInRoot(rootFd, parent, O_PATH | O_DIRECTORY);
+}
+
+static int MakeDirAt(int rootFd, const char *relPath, mode_t mode)
+{
+    const char *leaf = NULL;
+    int parentFd = OpenParentInRoot(rootFd, relPath, &leaf);
+    if (parentFd < 0) {
+        return -1;
+    }
+    int ret = mkdirat(parentFd, leaf, mode);
+    close(parentFd);
+    return (ret != 0 && errno != EEXIST) ? -1 : 0;
+}
+
+static int WriteAll(int fd, const char *buf, size_t len)
+{
+    size_t written = 0;
+    while (written < len) {
+        ssize_t ret = write(fd, buf + written, len - written);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return -1;
+        }
+        written += (size_t)ret;
+    }
+    return 0;
+}
+
+// 依次尝试reflink、copy_file_range，均不可用时回退为读写拷贝
+int CopyFileContent(int srcFd, int dstFd, off_t size)
+{
+    if (ioctl(dstFd, FICLONE_REQUEST, srcFd) == 0) {
+        return 0;
+    }
+    off_t copied = 0;
+#ifdef SYS_copy_file_range
+    while (copied < size) {
+        long ret = syscall(SYS_copy_file_range, srcFd, NULL, dstFd, NULL, (size_t)(size - copied), 0U);
+        if (ret <= 0) {
+            break; // 跨文件系统或内核不支持，从当前偏移继续读写拷贝
+        }
+        copied += ret;
+    }
+#endif
+    char buf[COPY_BUF_SIZE];
+    while (copied < size) {
+        ssize_t ret = read(srcFd, buf, sizeof(buf));
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0 || WriteAll(dstFd, buf, (size_t)ret) < 0) {
+            return -1;
+        }
+        copied += ret;
+    }
+    return 0;
+}
+
+int MakeDirWithParentAt(int rootFd, const char *path, mode_t mode)
+{
+    if (path == NULL) {
+        (void)fprintf(stderr, "path pointer is null!\n");
+        return -1;
+    }
+
+    const char *relPath = TrimRootPrefix(path);
+    if (*relPath == '\0' || strcmp(relPath, ".") == 0) {
+        return 0;
+    }
+    if (IsDirCached(relPath)) {
+        return 0;
+    }
+
+    // 镜像中已存在的目录只需一次解析
+    int fd = OpenInRoot(rootFd, relPath, O_PATH | O_DIRECTORY);
+    if (fd >= 0) {
+        close(fd);
+        CacheDir(relPath);
+        return 0;
+    }
+    if (errno != ENOENT) {
+        return -1;
+    }
+
+    char buf[PATH_MAX] = {0};
+    if (strcpy_s(buf, PATH_MAX, relPath) != EOK) {
+        return -1;
+    }
+    char *sep = buf;
+    do {
+        sep = strchr(sep + 1, '/');
+        if (sep != NULL) {
+            *sep = '\0';
+        }
+        if (!IsDirCached(buf)) {
+            if (MakeDirAt(rootFd, buf, mode) < 0) {
+                return -1;
+            }
+            CacheDir(buf);
+        }
+        if (sep != NULL) {
+            *sep = '/';
+        }
+    } while (sep != NULL);
+
+    return 0;
+}
+
+// 创建文件挂载点，返回指向挂载点的fd，由调用者关闭
+int MakeMountPointsAt(int rootFd, const char *path, mode_t mode)
+{
+    if (path == NULL) {
+        (void)fprintf(stderr, "path pointer is null!\n");
+        return -1;
+    }
+
+    const char *relPath = TrimRootPrefix(path);
+    int fd = OpenInRoot(rootFd, relPath, O_PATH);
+    if (fd >= 0) {
+        return fd;
+    }
+    if (errno != ENOENT) {
+        Logger("failed to resolve mount point.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+
+    /* directory */
+    char parentDir[BUF_SIZE] = {0};
+    GetParentPathStr(relPath, parentDir, BUF_SIZE);
+    if (MakeDirWithParentAt(rootFd, parentDir, DEFAULT_DIR_MODE) < 0) {
+        Logger("Failed to make parent dir for file.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+
+    const char *leaf = NULL;
+    int parentFd = OpenParentInRoot(rootFd, relPath, &leaf);
+    if (parentFd < 0) {
+        Logger("failed to resolve parent dir for file.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    fd = openat(parentFd, leaf, O_RDONLY | O_NOFOLLOW | O_CREAT | O_CLOEXEC, mode);
+    close(parentFd);
+    if (fd < 0) {
+        Logger("cannot create file.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    return fd;
+}
+
+// 创建目录挂载点，返回指向挂载点的fd，由调用者关闭
+int MakeMountDirAt(int rootFd, const char *path, mode_t mode)
+{
+    if (path == NULL) {
+        (void)fprintf(stderr, "path pointer is null!\n");
+        return -1;
+    }
+
+    int fd = OpenInRoot(rootFd, path, O_PATH | O_DIRECTORY);
+    if (fd >= 0 || errno != ENOENT) {
+        return fd;
+    }
+    if (MakeDirWithParentAt(rootFd, path, mode) < 0) {
+        return -1;
+    }
+    return OpenInRoot(rootFd, path, O_PATH | O_DIRECTORY);
+}
+
 static bool ShowExceptionInfo(const char* exceptionInfo)
 {
     (void)fprintf(stderr, "%s\n", exceptionInfo);
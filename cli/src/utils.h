@@ -31,6 +31,14 @@ int CheckDirExists(const char *dir);
 int GetParentPathStr(const char *path, char *parent, size_t bufSize);
 int MakeDirWithParent(const char *path, mode_t mode);
 int MakeMountPoints(const char *path, mode_t mode);
+unsigned int HashPath(const char *path);
+int GetProcFdPath(int fd, char *buf, size_t bufSize);
+int OpenInRoot(int rootFd, const char *path, int flags);
+int CopyFileContent(int srcFd, int dstFd, off_t size);
+int MakeDirWithParentAt(int rootFd, const char *path, mode_t mode);
+int MakeMountPointsAt(int rootFd, const char *path, mode_t mode);
+int MakeMountDirAt(int rootFd, const char *path, mode_t mode);
+void ResetMountPointCache(void);
 bool IsValidChar(const char c);
 bool CheckExternalFile(const char* filePath, const size_t filePathLen,
     const size_t maxFileSzieMb, const bool checkOwner);
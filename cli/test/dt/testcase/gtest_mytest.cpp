@@ -15,8 +15,12 @@
 #include <string>
 #include <iostream>
 #include <limits.h>
+#include <dirent.h>
+#include <stdlib.h>
 #include <sys/mount.h>
 #include <unistd.h>
+#include <sched.h>
+#include <sys/wait.h>
 #include "securec.h"
 #include "gtest/gtest.h"
 #include "mockcpp/mockcpp.hpp"
@@ -42,7 +46,7 @@ extern "C" int close(int fd);
 extern "C" int stat(const char *file_name, struct stat *buf);
 extern "C" int mount(const char *source, const char *target,
                      const char *filesystemtype, unsigned long mountflags, const void *data);
-extern "C" int Mount(const char *src, const char *dst);
+extern "C" int Mount(int srcFd, int rootfsFd, const char *dst, int dstFd);
 STATIC int MkDir(const char *dir, mode_t mode);
 extern "C" int rmdir(const char *pathname);
 extern "C" int EnterNsByFd(int fd, int nsType);
@@ -53,24 +57,69 @@ extern "C" int EnterNsByPath(const char *path, int nsType);
 extern "C" int CheckDirExists(char *dir, int len);
 extern "C" int GetParentPathStr(const char *path, char *parent, size_t bufSize);
 extern "C" int MakeDirWithParent(const char *path, mode_t mode);
-extern "C" int MountDir(const char *rootfs, const char *file, unsigned long reMountRwFlag);
+extern "C" int MountDir(int rootfsFd, const char *src, const struct MountSource *source);
+extern "C" bool VerifyMountSource(const char *src, struct MountSource *source);
+extern "C" bool VerifyMountSourceFd(const char *src, int fd, struct MountSource *source);
+extern "C" bool EnsureMountSourceVerified(const char *src, struct MountSource *source);
+extern "C" int OpenMountTree(const char *src, const struct MountSource *source);
 extern "C" int SetupContainer(struct CmdArgs *args);
 extern "C" int Process(int argc, char **argv);
-extern "C" int DoFileMounting(const char *rootfs, const struct MountList *list);
+extern "C" int DoFileMounting(int rootfsFd, const struct MountList *list);
 extern "C" int DoMounting(const struct ParsedConfig *config);
-extern "C" int DoDirectoryMounting(const char *rootfs, const struct MountList *list);
+extern "C" int DoDirectoryMounting(int rootfsFd, const struct MountList *list);
 extern "C" int DoPrepare(const struct CmdArgs *args, struct ParsedConfig *config);
 extern "C" int ParseRuntimeOptions(const char *options);
 extern "C" bool IsOptionNoDrvSet();
 extern "C" bool IsVirtual();
+extern "C" bool IsOptionStagingSet();
+extern "C" bool IsValidRuntimeOptions(const char *options);
+extern "C" int ReadOciState(FILE *stream, struct OciHookInfo *info);
 extern "C" int MakeMountPoints(const char *path, mode_t mode);
+extern "C" int CopyFileContent(int srcFd, int dstFd, off_t size);
+extern "C" int MakeDirWithParentAt(int rootFd, const char *path, mode_t mode);
+extern "C" int MakeMountPointsAt(int rootFd, const char *path, mode_t mode);
+extern "C" int MakeMountDirAt(int rootFd, const char *path, mode_t mode);
+extern "C" int OpenInRoot(int rootFd, const char *path, int flags);
+extern "C" void ResetMountPointCache(void);
+extern "C" int LoadMountInfo(const char *mountInfoPath);
+extern "C" void FreeMountInfo(void);
 extern "C" int LogLoop(const char* filename);
 extern "C" bool TakeNthWord(char **pLine, unsigned int n, char **word);
 extern "C" bool CheckRootDir(char **pLine);
+extern "C" bool ParseSourceFd(const char *token, int *fd);
+extern "C" int MountStagingPrefix(int treeFd, int rootfsFd, const char *prefix);
+extern "C" void BeginMounting(const char *mountInfoPath);
+extern "C" void EndMounting(bool succeeded);
+extern "C" int openat(int dirFd, const char *path, int flags, ...);
+
+struct MountSource {
+    bool checked;
+    bool verified;
+    dev_t dev;
+    ino_t ino;
+    mode_t mode;
+};
 
 struct MountList {
     unsigned int count;
     char list[MAX_MOUNT_NR][PATH_MAX];
+    struct MountSource sources[MAX_MOUNT_NR];
+};
+
+#define MAX_TARGET_NR 64
+
+struct OciHookInfo {
+    long pid;
+    char bundle[PATH_MAX];
+    char rootfs[PATH_MAX];
+    char visibleDevices[BUF_SIZE];
+    char runtimeOptions[BUF_SIZE];
+    char allowLink[BUF_SIZE];
+};
+
+struct Target {
+    char rootfs[BUF_SIZE];
+    long pid;
 };
 
 struct CmdArgs {
@@ -79,6 +128,10 @@ struct CmdArgs {
     char     options[BUF_SIZE];
     struct MountList files;
     struct MountList dirs;
+    char     sourceFds[BUF_SIZE];
+    struct Target targets[MAX_TARGET_NR];
+    unsigned int pidNr;
+    unsigned int rootfsNr;
 };
 
 struct ParsedConfig {
@@ -147,12 +200,12 @@ int stub_mount_success(const char *source, const char *target,
     return 0;
 }
 
-int stub_Mount_success(const char *src, const char *dst)
+int stub_Mount_success(int srcFd, int rootfsFd, const char *dst, int dstFd)
 {
     return 0;
 }
 
-int stub_Mount_failed(const char *src, const char *dst)
+int stub_Mount_failed(int srcFd, int rootfsFd, const char *dst, int dstFd)
 {
     return -1;
 }
@@ -183,12 +236,12 @@ int Stub_MountDevice_Failed(const char *rootfs, const char *deviceName)
     return -1;
 }
 
-int Stub_MountDir_Success(const char *rootfs, const char *file, unsigned long reMountRwFlag)
+int Stub_MountDir_Success(int rootfsFd, const char *src, const struct MountSource *source)
 {
     return 0;
 }
 
-int Stub_MountDir_Failed(const char *rootfs, const char *file, unsigned long reMountRwFlag)
+int Stub_MountDir_Failed(int rootfsFd, const char *src, const struct MountSource *source)
 {
     return -1;
 }
@@ -208,6 +261,29 @@ int Stub_MakeDirWithParent_Failed(const char *path, mode_t mode)
     return -1;
 }
 
+struct MountSource GetVerifiedSource(const char *path)
+{
+    struct MountSource source = {0};
+    struct stat srcStat;
+    if (stat(path, &srcStat) == 0) {
+        source.verified = true;
+        source.dev = srcStat.st_dev;
+        source.ino = srcStat.st_ino;
+        source.mode = srcStat.st_mode;
+    }
+    return source;
+}
+
+int Stub_MakeMountDirAt_Success(int rootFd, const char *path, mode_t mode)
+{
+    return dup(STDOUT_FILENO);
+}
+
+int Stub_MakeMountDirAt_Failed(int rootFd, const char *path, mode_t mode)
+{
+    return -1;
+}
+
 int Stub_CheckDirExists_Failed(char *dir, int len)
 {
     return -1;
@@ -243,22 +319,22 @@ int Stub_DoCtrlDeviceMounting_Failed(const char *rootfs)
     return -1;
 }
 
-int Stub_DoDirectoryMounting_Success(const char *rootfs, const struct MountList *list)
+int Stub_DoDirectoryMounting_Success(int rootfsFd, const struct MountList *list)
 {
     return 0;
 }
 
-int Stub_DoDirectoryMounting_Failed(const char *rootfs, const struct MountList *list)
+int Stub_DoDirectoryMounting_Failed(int rootfsFd, const struct MountList *list)
 {
     return -1;
 }
 
-int Stub_DoFileMounting_Success(const char *rootfs, const struct MountList *list)
+int Stub_DoFileMounting_Success(int rootfsFd, const struct MountList *list)
 {
     return 0;
 }
 
-int Stub_DoFileMounting_Failed(const char *rootfs, const struct MountList *list)
+int Stub_DoFileMounting_Failed(int rootfsFd, const struct MountList *list)
 {
     return -1;
 }
@@ -423,8 +499,7 @@ TEST_F(Test_Fhho,  StatusOneDoDirectoryMounting)
     MOCKER(MountDir).stubs().will(invoke(Stub_MountDir_Failed));
     struct MountList list = {0};
     list.count = 1;
-    char *rootfs = "/home";
-    int ret = DoDirectoryMounting(rootfs, &list);
+    int ret = DoDirectoryMounting(-1, &list);
     GlobalMockObject::verify();
     EXPECT_EQ(-1, ret);
 }
@@ -434,8 +509,7 @@ TEST_F(Test_Fhho, StatusTwoDoDirectoryMounting)
     MOCKER(MountDir).stubs().will(invoke(Stub_MountDir_Success));
     struct MountList list = {0};
     list.count = 3;
-    char *rootfs = "/home";
-    int ret = DoDirectoryMounting(rootfs, &list);
+    int ret = DoDirectoryMounting(-1, &list);
     GlobalMockObject::verify();
     EXPECT_EQ(0, ret);
 }
@@ -495,6 +569,199 @@ TEST_F(Test_Fhho, MakeMountPoints1)
     EXPECT_EQ(-1, ret);
 }
 
+TEST_F(Test_Fhho, MakeDirWithParentAtCreatesMissingParents)
+{
+    char rootfs[] = "/tmp/ascend-docker-ut-XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(rootfs));
+    DIR *rootDir = opendir(rootfs);
+    ASSERT_NE(nullptr, rootDir);
+    int rootFd = dirfd(rootDir);
+    EXPECT_EQ(0, MakeDirWithParentAt(rootFd, "/usr/local/Ascend/driver/lib64", 0755));
+    // 已缓存的目录再次创建直接返回
+    EXPECT_EQ(0, MakeDirWithParentAt(rootFd, "/usr/local/Ascend/driver/lib64", 0755));
+    int fileFd = MakeMountPointsAt(rootFd, "/usr/local/Ascend/driver/version.info", 0644);
+    EXPECT_LE(0, fileFd);
+    close(fileFd);
+    struct stat fileStat;
+    EXPECT_EQ(0, fstatat(rootFd, "usr/local/Ascend/driver/version.info", &fileStat, 0));
+    EXPECT_EQ(-1, MakeDirWithParentAt(rootFd, "/usr/local/Ascend/driver/version.info", 0755));
+    ResetMountPointCache();
+    closedir(rootDir);
+    EXPECT_EQ(0, system((std::string("rm -rf ") + rootfs).c_str()));
+}
+
+TEST_F(Test_Fhho, MakeDirWithParentAtCreatesDotfileDir)
+{
+    char rootfs[] = "/tmp/ascend-docker-ut-XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(rootfs));
+    DIR *rootDir = opendir(rootfs);
+    ASSERT_NE(nullptr, rootDir);
+    int rootFd = dirfd(rootDir);
+    EXPECT_EQ(0, MakeDirWithParentAt(rootFd, "/.config/ascend", 0755));
+    struct stat dirStat;
+    EXPECT_EQ(0, fstatat(rootFd, ".config/ascend", &dirStat, 0));
+    EXPECT_TRUE(S_ISDIR(dirStat.st_mode));
+    ResetMountPointCache();
+    closedir(rootDir);
+    EXPECT_EQ(0, system((std::string("rm -rf ") + rootfs).c_str()));
+}
+
+TEST_F(Test_Fhho, OpenInRootKeepsAbsoluteLinkInsideRootfs)
+{
+    char rootfs[] = "/tmp/ascend-docker-ut-XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(rootfs));
+    std::string root(rootfs);
+    EXPECT_EQ(0, system(("mkdir -p " + root + "/usr/lib && ln -s /usr/lib " + root + "/usr/lib64").c_str()));
+    DIR *rootDir = opendir(rootfs);
+    ASSERT_NE(nullptr, rootDir);
+    int rootFd = dirfd(rootDir);
+    int fileFd = MakeMountPointsAt(rootFd, "/usr/lib64/libdcmi.so", 0644);
+    EXPECT_LE(0, fileFd);
+    close(fileFd);
+    struct stat fileStat;
+    EXPECT_EQ(0, stat((root + "/usr/lib/libdcmi.so").c_str(), &fileStat));
+    ResetMountPointCache();
+    closedir(rootDir);
+    EXPECT_EQ(0, system(("rm -rf " + root).c_str()));
+}
+
+TEST_F(Test_Fhho, VerifyMountSourceFdMatchesPath)
+{
+    char source[] = "/tmp/ascend-docker-ut-XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(source));
+    DIR *sourceDir = opendir(source);
+    ASSERT_NE(nullptr, sourceDir);
+    struct MountSource mountSource = {0};
+    EXPECT_TRUE(VerifyMountSourceFd(source, dirfd(sourceDir), &mountSource));
+    EXPECT_TRUE(mountSource.verified);
+    EXPECT_FALSE(VerifyMountSourceFd("/home", dirfd(sourceDir), &mountSource));
+    EXPECT_FALSE(mountSource.verified);
+    closedir(sourceDir);
+    rmdir(source);
+}
+
+TEST_F(Test_Fhho, ParseSourceFdAcceptsOnlyOpathFds)
+{
+#ifndef O_PATH
+    const int O_PATH = 010000000;
+#endif
+    int fd = -1;
+    EXPECT_FALSE(ParseSourceFd("0", &fd));
+    EXPECT_FALSE(ParseSourceFd("2", &fd));
+    EXPECT_FALSE(ParseSourceFd("abc", &fd));
+    EXPECT_FALSE(ParseSourceFd("", &fd));
+    DIR *tmpDir = opendir("/tmp");
+    ASSERT_NE(nullptr, tmpDir);
+    // 非O_PATH打开的fd不接受, 也不被关闭
+    std::string token = std::to_string(dirfd(tmpDir));
+    EXPECT_FALSE(ParseSourceFd(token.c_str(), &fd));
+    EXPECT_FALSE(ParseSourceFd((token + "x").c_str(), &fd));
+    int pathFd = openat(-1, "/tmp", O_PATH);
+    ASSERT_GT(pathFd, 2);
+    EXPECT_TRUE(ParseSourceFd(std::to_string(pathFd).c_str(), &fd));
+    EXPECT_EQ(pathFd, fd);
+    close(pathFd);
+    EXPECT_FALSE(ParseSourceFd(std::to_string(pathFd).c_str(), &fd));
+    closedir(tmpDir);
+}
+
+static int CountMountsAt(const std::string &path)
+{
+    FILE *mountInfo = fopen("/proc/self/mountinfo", "r");
+    if (mountInfo == nullptr) {
+        return -1;
+    }
+    char line[PATH_MAX] = {0};
+    int count = 0;
+    while (fgets(line, sizeof(line), mountInfo) != nullptr) {
+        count += (strstr(line, (" " + path + " ").c_str()) != nullptr) ? 1 : 0;
+    }
+    fclose(mountInfo);
+    return count;
+}
+
+// 在子进程的私有挂载命名空间中两次挂载staging前缀, 第二次应识别为已挂载而跳过
+static int MountStagingPrefixTwice(const std::string &tree, const std::string &rootfs)
+{
+#ifndef O_PATH
+    const int O_PATH = 010000000;
+#endif
+    const char *prefix = "/usr/local/Ascend/driver";
+    if (unshare(CLONE_NEWNS) != 0 || mount(nullptr, "/", nullptr, MS_REC | MS_PRIVATE, nullptr) != 0) {
+        return 1;
+    }
+    int treeFd = openat(-1, tree.c_str(), O_PATH);
+    int rootfsFd = openat(-1, rootfs.c_str(), O_PATH);
+    if (treeFd < 0 || rootfsFd < 0) {
+        return 1;
+    }
+    for (int i = 0; i < 2; i++) {
+        BeginMounting("/proc/self/mountinfo");
+        int ret = MountStagingPrefix(treeFd, rootfsFd, prefix);
+        EndMounting(ret >= 0);
+        if (ret < 0) {
+            return 1;
+        }
+    }
+    return (CountMountsAt(rootfs + prefix) == 1) ? 0 : 1;
+}
+
+TEST_F(Test_Fhho, MountStagingPrefixSkipsWhenAlreadyMounted)
+{
+    char tree[] = "/root/ascend-docker-ut-tree-XXXXXX";
+    char rootfs[] = "/root/ascend-docker-ut-rootfs-XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(tree));
+    ASSERT_NE(nullptr, mkdtemp(rootfs));
+    ASSERT_EQ(0, system(("mkdir -p " + std::string(tree) + "/usr/local/Ascend/driver").c_str()));
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+        _exit(MountStagingPrefixTwice(tree, rootfs));
+    }
+    int status = 0;
+    EXPECT_EQ(pid, waitpid(pid, &status, 0));
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    EXPECT_EQ(0, system(("rm -rf " + std::string(tree) + " " + std::string(rootfs)).c_str()));
+}
+
+TEST_F(Test_Fhho, CopyFileContentCopiesWholeFile)
+{
+    char src[] = "/tmp/ascend-docker-ut-src-XXXXXX";
+    char dst[] = "/tmp/ascend-docker-ut-dst-XXXXXX";
+    int srcFd = mkstemp(src);
+    int dstFd = mkstemp(dst);
+    ASSERT_LE(0, srcFd);
+    ASSERT_LE(0, dstFd);
+    std::string content(100000, 'a');
+    EXPECT_EQ((ssize_t)content.size(), write(srcFd, content.c_str(), content.size()));
+    EXPECT_EQ(0, lseek(srcFd, 0, SEEK_SET));
+    EXPECT_EQ(0, CopyFileContent(srcFd, dstFd, (off_t)content.size()));
+    struct stat dstStat;
+    EXPECT_EQ(0, stat(dst, &dstStat));
+    EXPECT_EQ((off_t)content.size(), dstStat.st_size);
+    close(srcFd);
+    close(dstFd);
+    unlink(src);
+    unlink(dst);
+}
+
+TEST_F(Test_Fhho, LoadMountInfoParsesEscapedMountPoints)
+{
+    char mountInfo[] = "/tmp/ascend-docker-ut-mountinfo-XXXXXX";
+    int fd = mkstemp(mountInfo);
+    ASSERT_LE(0, fd);
+    const char content[] =
+        "22 1 8:1 / / rw,relatime shared:1 - ext4 /dev/sda1 rw\n"
+        "35 22 8:1 /etc/hdcBasic.cfg /etc/hdc\\040Basic.cfg ro,nosuid,relatime - ext4 /dev/sda1 rw\n"
+        "broken line\n";
+    EXPECT_EQ((ssize_t)strlen(content), write(fd, content, strlen(content)));
+    close(fd);
+    EXPECT_EQ(2, LoadMountInfo(mountInfo));
+    FreeMountInfo();
+    EXPECT_EQ(-1, LoadMountInfo("/tmp/ascend-docker-ut-not-exist"));
+    unlink(mountInfo);
+}
+
 TEST_F(Test_Fhho, LogLoopSuccess)
 {
     // The test create directory contains the parent directory
@@ -541,9 +808,8 @@ TEST_F(Test_Fhho, StatusThreeMountDir)
 {
     MOCKER(CheckDirExists).stubs().will(invoke(Stub_CheckDirExists_Failed));
     MOCKER(MkDir).stubs().will(invoke(stub_MkDir_failed));
-    char *rootfs = "/rootfs";
-    unsigned long reMountRwFlag = MS_BIND | MS_REMOUNT | MS_RDONLY | MS_NOSUID | MS_NOEXEC;
-    int ret = MountDir(rootfs, "/home", reMountRwFlag);
+    struct MountSource source = GetVerifiedSource("/home");
+    int ret = MountDir(-1, "/home", &source);
     GlobalMockObject::verify();
     EXPECT_EQ(-1, ret);
 }
@@ -552,10 +818,9 @@ TEST_F(Test_Fhho, StatusThreeMountDir)
 TEST_F(Test_Fhho, StatusTwoMountDir)
 {
     MOCKER(CheckDirExists).stubs().will(invoke(Stub_CheckDirExists_Failed));
-    MOCKER(MakeDirWithParent).stubs().will(invoke(Stub_MakeDirWithParent_Failed));
-    char *rootfs = "/rootfs";
-    unsigned long reMountRwFlag = MS_BIND | MS_REMOUNT | MS_RDONLY | MS_NOSUID | MS_NOEXEC;
-    int ret = MountDir(rootfs, "/home", reMountRwFlag);
+    MOCKER(MakeMountDirAt).stubs().will(invoke(Stub_MakeMountDirAt_Failed));
+    struct MountSource source = GetVerifiedSource("/home");
+    int ret = MountDir(-1, "/home", &source);
     GlobalMockObject::verify();
     EXPECT_EQ(-1, ret);
 }
@@ -563,11 +828,10 @@ TEST_F(Test_Fhho, StatusTwoMountDir)
 TEST_F(Test_Fhho, StatusFourMountDir)
 {
     MOCKER(CheckDirExists).stubs().will(invoke(Stub_CheckDirExists_Failed));
-    MOCKER(MakeDirWithParent).stubs().will(invoke(Stub_MakeDirWithParent_Success));
+    MOCKER(MakeMountDirAt).stubs().will(invoke(Stub_MakeMountDirAt_Success));
     MOCKER(mount).stubs().will(invoke(stub_mount_failed));
-    char *rootfs = "/rootfs";
-    unsigned long reMountRwFlag = MS_BIND | MS_REMOUNT | MS_RDONLY | MS_NOSUID | MS_NOEXEC;
-    int ret = MountDir(rootfs, "/home", reMountRwFlag);
+    struct MountSource source = GetVerifiedSource("/home");
+    int ret = MountDir(-1, "/home", &source);
     GlobalMockObject::verify();
     EXPECT_EQ(-1, ret);
 }
@@ -575,15 +839,47 @@ TEST_F(Test_Fhho, StatusFourMountDir)
 TEST_F(Test_Fhho, StatusFiveMountDir)
 {
     MOCKER(stat).stubs().will(invoke(stub_stat_failed));
-    MOCKER(MakeDirWithParent).stubs().will(invoke(Stub_MakeDirWithParent_Success));
+    MOCKER(MakeMountDirAt).stubs().will(invoke(Stub_MakeMountDirAt_Success));
     MOCKER(Mount).stubs().will(invoke(stub_Mount_success));
-    char *rootfs = "/rootfs";
-    unsigned long reMountRwFlag = MS_BIND | MS_REMOUNT | MS_RDONLY | MS_NOSUID | MS_NOEXEC;
-    int ret = MountDir(rootfs, "/dev/random", reMountRwFlag);
+    struct MountSource source = {0};
+    int ret = MountDir(-1, "/dev/random", &source);
     GlobalMockObject::verify();
     EXPECT_EQ(0, ret);
 }
 
+TEST_F(Test_Fhho, MountDirRejectsChangedSource)
+{
+    MOCKER(MakeMountDirAt).stubs().will(invoke(Stub_MakeMountDirAt_Success));
+    MOCKER(Mount).stubs().will(invoke(stub_Mount_success));
+    struct MountSource source = GetVerifiedSource("/home");
+    source.ino++;
+    int ret = MountDir(-1, "/home", &source);
+    GlobalMockObject::verify();
+    EXPECT_EQ(-1, ret);
+}
+
+TEST_F(Test_Fhho, VerifyMountSourceSkipsMissingSource)
+{
+    struct MountSource source = GetVerifiedSource("/home");
+    EXPECT_TRUE(VerifyMountSource("/ascend-docker-ut-not-exist", &source));
+    EXPECT_FALSE(source.verified);
+}
+
+TEST_F(Test_Fhho, EnsureMountSourceVerifiedReusesCheckedSource)
+{
+    struct MountSource source = GetVerifiedSource("/home");
+    source.checked = true;
+    EXPECT_TRUE(EnsureMountSourceVerified("/ascend-docker-ut-not-exist", &source));
+    EXPECT_TRUE(source.verified);
+}
+
+TEST_F(Test_Fhho, OpenMountTreeRejectsChangedSource)
+{
+    struct MountSource source = GetVerifiedSource("/home");
+    source.ino++;
+    EXPECT_EQ(-1, OpenMountTree("/home", &source));
+}
+
 TEST_F(Test_Fhho, StatusOneSetupContainer)
 {
     struct CmdArgs args;
@@ -613,6 +909,27 @@ TEST_F(Test_Fhho, StatusTwoProcess)
     EXPECT_EQ(0, ret);
 }
 
+TEST_F(Test_Fhho, ProcessMultipleTargets)
+{
+    const int argc = 9;
+    const char *argvData[argc] = {"ascend-docker-cli", "--pid", "123", "--rootfs", "/home",
+        "--pid", "124", "--rootfs", "/home"};
+    MOCKER(SetupContainer).stubs().will(invoke(Stub_SetupContainer_Success));
+    int ret = Process(argc, const_cast<char **>(argvData));
+    GlobalMockObject::verify();
+    EXPECT_EQ(0, ret);
+}
+
+TEST_F(Test_Fhho, ProcessUnpairedTargets)
+{
+    const int argc = 7;
+    const char *argvData[argc] = {"ascend-docker-cli", "--pid", "123", "--rootfs", "/home", "--pid", "124"};
+    MOCKER(SetupContainer).stubs().will(invoke(Stub_SetupContainer_Success));
+    int ret = Process(argc, const_cast<char **>(argvData));
+    GlobalMockObject::verify();
+    EXPECT_EQ(-1, ret);
+}
+
 TEST_F(Test_Fhho, StatusThreeProcess)
 {
     // Test error options
@@ -674,6 +991,38 @@ TEST_F(Test_Fhho, StatusOneParseRuntimeOptions)
     EXPECT_EQ(0, ret);
 }
 
+TEST_F(Test_Fhho, IsValidRuntimeOptionsAcceptsKnownOptions)
+{
+    EXPECT_TRUE(IsValidRuntimeOptions("NODRV,VIRTUAL"));
+    EXPECT_TRUE(IsValidRuntimeOptions("STAGING,VIRTUAL"));
+    EXPECT_TRUE(IsValidRuntimeOptions("COPYIN"));
+    EXPECT_FALSE(IsValidRuntimeOptions("STAGING,UNKNOWN"));
+    EXPECT_FALSE(IsValidRuntimeOptions(","));
+    ParseRuntimeOptions("VIRTUAL,STAGING");
+    EXPECT_TRUE(IsOptionStagingSet());
+    ParseRuntimeOptions("VIRTUAL");
+    EXPECT_FALSE(IsOptionStagingSet());
+}
+
+TEST_F(Test_Fhho, ReadOciStateParsesPidAndBundle)
+{
+    char state[] = "{\"ociVersion\":\"1.0.2\",\"id\":\"a\\u00e9\",\"pid\":123,"
+        "\"annotations\":{\"k\":[1,true,null,{}]},\"bundle\":\"/run/bundle\"}";
+    static struct OciHookInfo info;
+    FILE *stream = fmemopen(state, strlen(state), "r");
+    ASSERT_TRUE(stream != NULL);
+    EXPECT_EQ(0, ReadOciState(stream, &info));
+    fclose(stream);
+    EXPECT_EQ(123, info.pid);
+    EXPECT_STREQ("/run/bundle", info.bundle);
+
+    char broken[] = "{\"pid\":123,\"bundle\":\"/run/bundle\"";
+    stream = fmemopen(broken, strlen(broken), "r");
+    ASSERT_TRUE(stream != NULL);
+    EXPECT_EQ(-1, ReadOciState(stream, &info));
+    fclose(stream);
+}
+
 TEST_F(Test_Fhho, StatusThreeDoPrepare)
 {
     MOCKER(GetNsPath).stubs().will(invoke(Stub_GetNsPath_Failed));
@@ -38,6 +38,18 @@
 #define PARAMS_THIRD       2
 #define PARAMS_FOURTH      3
 #define ID_MAX             65535
+#define ID_MAX_LEN         5
+#define BATCH_FLAG         "--batch"
+#define BATCH_PARAMS_START 2
+#define BATCH_ITEM_PARAMS  3
+#define BATCH_MAX          1024
+#define BATCH_LINE_LEN     64
+
+struct VDeviceItem {
+    int cardId;
+    int deviceId;
+    int vDeviceId;
+};
 
 static bool ShowExceptionInfo(const char* exceptionInfo)
 {
@@ -253,6 +265,137 @@ static bool DcmiDestroyProcess(void *handle, const int cardId,
     return true;
 }
 
+static bool ParseId(const char *str, int *id)
+{
+    size_t len = strlen(str);
+    if (len == 0 || len > ID_MAX_LEN) {
+        return false;
+    }
+    for (size_t iLoop = 0; iLoop < len; iLoop++) {
+        if (isdigit((unsigned char)str[iLoop]) == 0) {
+            return false;
+        }
+    }
+    *id = atoi(str);
+    return CheckLimitId(*id);
+}
+
+static bool ParseItem(const char *card, const char *device, const char *vDevice, struct VDeviceItem *item)
+{
+    return ParseId(card, &item->cardId) && ParseId(device, &item->deviceId) &&
+        ParseId(vDevice, &item->vDeviceId);
+}
+
+// 按空白切分line, 最多maxNum个字段, 多出的字段也计数
+static int SplitFields(char *line, char *fields[], const int maxNum)
+{
+    int num = 0;
+    char *pos = line;
+    while (*pos != '\0') {
+        while (isspace((unsigned char)*pos) != 0) {
+            *pos++ = '\0';
+        }
+        if (*pos == '\0') {
+            break;
+        }
+        if (num < maxNum) {
+            fields[num] = pos;
+        }
+        num++;
+        while (*pos != '\0' && isspace((unsigned char)*pos) == 0) {
+            pos++;
+        }
+    }
+    return num;
+}
+
+// 每行一个 "card device vdevice"
+static int ReadItemsFromStdin(struct VDeviceItem *items, const int maxNum)
+{
+    char line[BATCH_LINE_LEN] = {0};
+    char *fields[BATCH_ITEM_PARAMS] = {NULL};
+    int num = 0;
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        if (strchr(line, '\n') == NULL && !feof(stdin)) {
+            Logger("destroy batch line too long.", LEVEL_ERROR, SCREEN_YES);
+            return -1;
+        }
+        int ret = SplitFields(line, fields, BATCH_ITEM_PARAMS);
+        if (ret == 0) {
+            continue; // 空行
+        }
+        if (ret != BATCH_ITEM_PARAMS || num >= maxNum ||
+            !ParseItem(fields[0], fields[PARAMS_SECOND], fields[PARAMS_THIRD], &items[num])) {
+            Logger("destroy batch item error.", LEVEL_ERROR, SCREEN_YES);
+            return -1;
+        }
+        num++;
+    }
+    return num;
+}
+
+static int ReadItemsFromArgs(const int argc, const char *argv[], struct VDeviceItem *items, const int maxNum)
+{
+    int paramsNum = argc - BATCH_PARAMS_START;
+    if (paramsNum % BATCH_ITEM_PARAMS != 0 || paramsNum / BATCH_ITEM_PARAMS > maxNum) {
+        Logger("destroy batch params number error.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    int num = 0;
+    for (int iLoop = BATCH_PARAMS_START; iLoop < argc; iLoop += BATCH_ITEM_PARAMS) {
+        if (!ParseItem(argv[iLoop], argv[iLoop + PARAMS_SECOND], argv[iLoop + PARAMS_THIRD], &items[num])) {
+            Logger("destroy batch params value error.", LEVEL_ERROR, SCREEN_YES);
+            return -1;
+        }
+        num++;
+    }
+    return num;
+}
+
+// 批量销毁: libdcmi只加载校验和初始化一次, 每一项在标准输出报告结果
+static int BatchDestroyEntrance(const int argc, const char *argv[])
+{
+    static struct VDeviceItem items[BATCH_MAX];
+    int num = (argc > BATCH_PARAMS_START) ? ReadItemsFromArgs(argc, argv, items, BATCH_MAX) :
+        ReadItemsFromStdin(items, BATCH_MAX);
+    if (num <= 0) {
+        return -1;
+    }
+
+    void *handle = NULL;
+    if (!DeclareDcmiApiAndCheck(&handle)) {
+        Logger("Declare dcmi failed.", LEVEL_ERROR, SCREEN_YES);
+        return -1;
+    }
+    if (!DcmiInitProcess(handle)) {
+        return -1;
+    }
+    int (*dcmi_set_destroy_vdevice)(int, int, int) = NULL;
+    dcmi_set_destroy_vdevice = dlsym(handle, DCMI_SET_DESTROY_VDEVICE);
+    if (dcmi_set_destroy_vdevice == NULL) {
+        DcmiDlAbnormalExit(&handle, "DeclareDlApi failed");
+        return -1;
+    }
+
+    int failed = 0;
+    for (int iLoop = 0; iLoop < num; iLoop++) {
+        int ret = dcmi_set_destroy_vdevice(items[iLoop].cardId, items[iLoop].deviceId, items[iLoop].vDeviceId);
+        (void)printf("%d %d %d %s\n", items[iLoop].cardId, items[iLoop].deviceId, items[iLoop].vDeviceId,
+            (ret == 0) ? "ok" : "failed");
+        if (ret != 0) {
+            char *str = FormatLogMessage("destroy v-device %d failed, error code: %d", items[iLoop].vDeviceId, ret);
+            Logger(str, LEVEL_ERROR, SCREEN_NO);
+            free(str);
+            failed++;
+        }
+    }
+    DcmiDlclose(&handle);
+    char *strEnd = FormatLogMessage("destroy %d v-devices, %d failed", num, failed);
+    Logger(strEnd, LEVEL_INFO, SCREEN_YES);
+    free(strEnd);
+    return (failed == 0) ? 0 : -1;
+}
+
 static int DestroyEntrance(const char *argv[])
 {
     if (argv == NULL) {
@@ -304,6 +447,9 @@ static bool EntryCheck(const int argc, const char *argv[])
 
 int main(const int argc, const char *argv[])
 {
+    if (argc > 1 && strcmp(argv[1], BATCH_FLAG) == 0) {
+        return BatchDestroyEntrance(argc, argv);
+    }
     if (!EntryCheck(argc, argv)) {
         Logger("destroy params value error.", LEVEL_ERROR, SCREEN_YES);
         return -1;
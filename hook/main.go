@@ -16,7 +16,6 @@
 package main
 
 import (
-	"bufio"
 	"context"
 	"encoding/json"
 	"fmt"
@@ -42,9 +41,6 @@ const (
 	ascendAllowLink        = "ASCEND_ALLOW_LINK"
 	ascendDockerCli        = "ascend-docker-cli"
 	defaultAscendDockerCli = "/usr/local/bin/ascend-docker-cli"
-	configDir              = "/etc/ascend-docker-runtime.d"
-	baseConfig             = "base"
-	configFileSuffix       = "list"
 
 	kvPairSize       = 2
 	maxCommandLength = 65535
@@ -60,6 +56,14 @@ var (
 var validRuntimeOptions = [...]string{
 	"NODRV",
 	"VIRTUAL",
+	"STAGING",
+	"COPYIN",
+}
+
+// mountSource is a mount source opened and checked by the hook, the fd is inherited by ascend-docker-cli
+type mountSource struct {
+	path string
+	fd   int
 }
 
 type containerConfig struct {
@@ -86,25 +90,6 @@ func initLogModule(ctx context.Context) error {
 	return nil
 }
 
-func parseMounts(mounts string) []string {
-	if mounts == "" {
-		return []string{baseConfig}
-	}
-	const maxMountLength = 128
-	if len(mounts) > maxMountLength {
-		return []string{baseConfig}
-	}
-
-	mountConfigs := make([]string, 0)
-	for _, m := range strings.Split(mounts, ",") {
-		m = strings.TrimSpace(m)
-		m = strings.ToLower(m)
-		mountConfigs = append(mountConfigs, m)
-	}
-
-	return mountConfigs
-}
-
 func isRuntimeOptionValid(option string) bool {
 	for _, validOption := range validRuntimeOptions {
 		if option == validOption {
@@ -222,99 +207,54 @@ func getValueByKey(data []string, name string) string {
 	return ""
 }
 
-func readMountConfig(dir string, name string) ([]string, []string, error) {
-	configFileName := fmt.Sprintf("%s.%s", name, configFileSuffix)
-	baseConfigFilePath, err := filepath.Abs(filepath.Join(dir, configFileName))
-	if err != nil {
-		return nil, nil, fmt.Errorf("failed to assemble base config file path: %v", err)
-	}
-
-	fileInfo, err := os.Stat(baseConfigFilePath)
-	if _, err := mindxcheckutils.RealFileChecker(baseConfigFilePath, true, false,
-		mindxcheckutils.DefaultSize); err != nil {
-		return nil, nil, err
+func closeMountSources(sources []mountSource) {
+	for _, source := range sources {
+		syscall.Close(source.fd)
 	}
-	if err != nil {
-		return nil, nil, fmt.Errorf("cannot stat base configuration file %s : %v", baseConfigFilePath, err)
-	}
-
-	if !fileInfo.Mode().IsRegular() {
-		return nil, nil, fmt.Errorf("base configuration file damaged because is not a regular file")
-	}
-
-	f, err := os.Open(baseConfigFilePath)
-	if err != nil {
-		return nil, nil, fmt.Errorf("failed to open base configuration file %s: %v", baseConfigFilePath, err)
-	}
-	defer f.Close()
+}
 
-	fileMountList, dirMountList := make([]string, 0), make([]string, 0)
-	const maxEntryNumber = 128
-	entryCount := 0
-	scanner := bufio.NewScanner(f)
-	for scanner.Scan() {
-		mountPath := scanner.Text()
-		entryCount = entryCount + 1
-		if entryCount > maxEntryNumber {
-			return nil, nil, fmt.Errorf("mount list too long")
+// openMountSources opens every mount source without O_CLOEXEC so that ascend-docker-cli inherits the fds,
+// sources which no longer exist are skipped
+func openMountSources(paths []string, allowLink bool) ([]mountSource, error) {
+	flags := mindxcheckutils.OPath
+	if !allowLink {
+		flags |= syscall.O_NOFOLLOW
+	}
+	sources := make([]mountSource, 0, len(paths))
+	for _, sourcePath := range paths {
+		fd, err := syscall.Open(sourcePath, flags, 0)
+		if err == syscall.ENOENT {
+			continue
 		}
-		absMountPath, err := filepath.Abs(mountPath)
 		if err != nil {
-			continue // skipping files/dirs with any problems
+			closeMountSources(sources)
+			return nil, fmt.Errorf("failed to open mount source %s: %v", sourcePath, err)
 		}
-		mountPath = absMountPath
-
-		stat, err := os.Stat(mountPath)
-		if err != nil {
-			continue // skipping files/dirs with any problems
+		sources = append(sources, mountSource{path: sourcePath, fd: fd})
+		if err := mindxcheckutils.MountSourceChecker(fd, sourcePath, allowLink); err != nil {
+			closeMountSources(sources)
+			return nil, err
 		}
-
-		if stat.Mode().IsRegular() {
-			fileMountList = append(fileMountList, mountPath)
-		} else if stat.Mode().IsDir() {
-			dirMountList = append(dirMountList, mountPath)
-		}
-	}
-
-	return fileMountList, dirMountList, nil
-}
-
-func readConfigsOfDir(dir string, configs []string) ([]string, []string, error) {
-	fileInfo, err := os.Stat(dir)
-	if err != nil {
-		return nil, nil, fmt.Errorf("cannot stat configuration directory %s : %v", dir, err)
-	}
-
-	if !fileInfo.Mode().IsDir() {
-		return nil, nil, fmt.Errorf("%s should be a dir for ascend docker runtime, but now it is not", dir)
-	}
-
-	fileMountList := make([]string, 0)
-	dirMountList := make([]string, 0)
-
-	for _, config := range configs {
-		fileList, dirList, err := readMountConfig(dir, config)
-		if err != nil {
-			return nil, nil, fmt.Errorf("failed to process config %s: %v", config, err)
-		}
-
-		fileMountList = append(fileMountList, fileList...)
-		dirMountList = append(dirMountList, dirList...)
 	}
-
-	return fileMountList, dirMountList, nil
+	return sources, nil
 }
 
-func getArgs(cliPath string, containerConfig *containerConfig, fileMountList []string,
-	dirMountList []string, allowLink string) []string {
+func getArgs(cliPath string, containerConfig *containerConfig, fileSources []mountSource,
+	dirSources []mountSource, allowLink string) []string {
 	args := append([]string{cliPath},
 		"--allow-link", allowLink, "--pid", fmt.Sprintf("%d", containerConfig.Pid),
 		"--rootfs", containerConfig.Rootfs)
-	for _, filePath := range fileMountList {
-		args = append(args, "--mount-file", filePath)
+	sourceFds := make([]string, 0, len(fileSources)+len(dirSources))
+	for _, source := range fileSources {
+		args = append(args, "--mount-file", source.path)
+		sourceFds = append(sourceFds, fmt.Sprintf("%d", source.fd))
+	}
+	for _, source := range dirSources {
+		args = append(args, "--mount-dir", source.path)
+		sourceFds = append(sourceFds, fmt.Sprintf("%d", source.fd))
 	}
-	for _, dirPath := range dirMountList {
-		args = append(args, "--mount-dir", dirPath)
+	if len(sourceFds) > 0 {
+		args = append(args, "--source-fds", strings.Join(sourceFds, ","))
 	}
 	return args
 }
@@ -329,12 +269,17 @@ func doPrestartHook() error {
 		return nil
 	}
 
-	mountConfigs := parseMounts(getValueByKey(containerConfig.Env, ascendRuntimeMounts))
+	mountConfigs := mindxcheckutils.ParseMountProfiles(getValueByKey(containerConfig.Env, ascendRuntimeMounts))
 
-	fileMountList, dirMountList, err := readConfigsOfDir(configDir, mountConfigs)
+	fileMountList, dirMountList, err := mindxcheckutils.ReadMountProfiles(mindxcheckutils.MountProfileDir,
+		mountConfigs)
 	if err != nil {
 		return fmt.Errorf("failed to read configuration from config directory: %#v", err)
 	}
+	fileMountList, dirMountList, removed := mindxcheckutils.NormalizeMountLists(fileMountList, dirMountList)
+	if removed > 0 {
+		hwlog.RunLog.Infof("%d duplicated or covered mount entries eliminated", removed)
+	}
 
 	parsedOptions, err := parseRuntimeOptions(getValueByKey(containerConfig.Env, ascendRuntimeOptions))
 	if err != nil {
@@ -358,7 +303,16 @@ func doPrestartHook() error {
 	if _, err := mindxcheckutils.RealFileChecker(cliPath, true, false, mindxcheckutils.DefaultSize); err != nil {
 		return err
 	}
-	args := getArgs(cliPath, containerConfig, fileMountList, dirMountList, allowLink)
+	fileSources, err := openMountSources(fileMountList, allowLink == "True")
+	if err != nil {
+		return fmt.Errorf("failed to check mount files: %v", err)
+	}
+	dirSources, err := openMountSources(dirMountList, allowLink == "True")
+	if err != nil {
+		closeMountSources(fileSources)
+		return fmt.Errorf("failed to check mount dirs: %v", err)
+	}
+	args := getArgs(cliPath, containerConfig, fileSources, dirSources, allowLink)
 	if len(parsedOptions) > 0 {
 		args = append(args, "--options", strings.Join(parsedOptions, ","))
 	}
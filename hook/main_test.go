@@ -19,6 +19,7 @@ import (
 	"github.com/prashantv/gostub"
 	"os"
 	"os/exec"
+	"reflect"
 	"testing"
 )
 
@@ -190,3 +191,36 @@ func TestGetContainerConfig(t *testing.T) {
 
 	getContainerConfig()
 }
+
+func TestOpenMountSourcesSkipsMissingSource(t *testing.T) {
+	sources, err := openMountSources([]string{"/ascend-docker-ut-not-exist"}, false)
+	if err != nil || len(sources) != 0 {
+		t.Fatalf("missing source should be skipped, got %v %v", sources, err)
+	}
+}
+
+func TestOpenMountSourcesRejectsWritableParent(t *testing.T) {
+	dir := t.TempDir()
+	if err := os.Chmod(dir, 0777); err != nil {
+		t.Fatal(err)
+	}
+	file := dir + "/source.cfg"
+	if err := os.WriteFile(file, []byte("cfg"), 0644); err != nil {
+		t.Fatal(err)
+	}
+	if _, err := openMountSources([]string{file}, false); err == nil {
+		t.Fatal("source under a world writable dir should be rejected")
+	}
+}
+
+func TestGetArgsWithSourceFds(t *testing.T) {
+	conCfg := containerConfig{Pid: pidSample, Rootfs: "/rootfs"}
+	args := getArgs("cli", &conCfg, []mountSource{{path: "/etc/hdcBasic.cfg", fd: 3}},
+		[]mountSource{{path: "/usr/local/Ascend/driver/lib64", fd: 4}}, "False")
+	expect := []string{"cli", "--allow-link", "False", "--pid", "123", "--rootfs", "/rootfs",
+		"--mount-file", "/etc/hdcBasic.cfg", "--mount-dir", "/usr/local/Ascend/driver/lib64",
+		"--source-fds", "3,4"}
+	if !reflect.DeepEqual(args, expect) {
+		t.Fatalf("unexpected args %v", args)
+	}
+}
@@ -17,7 +17,9 @@ package mindxcheckutils
 
 import (
 	"os"
+	"reflect"
 	"strings"
+	"syscall"
 	"testing"
 )
 
@@ -167,3 +169,59 @@ func removeTmpDir(t *testing.T, tmpDir string) {
 		t.Logf("removeall %v", tmpDir)
 	}
 }
+
+func TestCheckSourceSubsetRejectsSoftLink(t *testing.T) {
+	dir := t.TempDir()
+	if err := os.Symlink("/etc/hostname", dir+"/link"); err != nil {
+		t.Fatal(err)
+	}
+	fd, err := syscall.Open(dir, OPath|syscall.O_DIRECTORY|syscall.O_CLOEXEC, 0)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer syscall.Close(fd)
+	if err := checkSourceSubset(fd, dir, false); err == nil {
+		t.Fatal("soft link inside a mounted dir should be rejected")
+	}
+	if err := checkSourceSubset(fd, dir, true); err != nil {
+		t.Fatalf("soft link should be allowed, got %v", err)
+	}
+}
+
+func TestParseMountProfiles(t *testing.T) {
+	if !reflect.DeepEqual(ParseMountProfiles(""), []string{BaseMountProfile}) {
+		t.Fatal("base profile should be used by default")
+	}
+	if !reflect.DeepEqual(ParseMountProfiles(strings.Repeat("a", maxMountsLength+1)), []string{BaseMountProfile}) {
+		t.Fatal("base profile should be used for a too long value")
+	}
+	if !reflect.DeepEqual(ParseMountProfiles(" Base, user "), []string{"base", "user"}) {
+		t.Fatalf("unexpected profiles %v", ParseMountProfiles(" Base, user "))
+	}
+}
+
+func TestReadMountProfilesRejectsInvalidName(t *testing.T) {
+	if _, _, err := ReadMountProfiles("/etc", []string{"../passwd"}); err == nil {
+		t.Fatal("profile name with slash should be rejected")
+	}
+	if _, _, err := ReadMountProfiles("/ascend-docker-ut-not-exist", []string{BaseMountProfile}); err == nil {
+		t.Fatal("missing profile dir should be rejected")
+	}
+}
+
+func TestNormalizeMountLists(t *testing.T) {
+	files := []string{"/usr/local/Ascend/driver/lib64/libdcmi.so", "/etc/hdcBasic.cfg", "/etc/hdcBasic.cfg",
+		"/usr/local/Ascend/driver/lib64-extra.so"}
+	dirs := []string{"/usr/local/Ascend/driver/tools", "/usr/local/Ascend/driver/lib64",
+		"/usr/local/Ascend/driver/lib64/common", "/usr/local/Ascend/driver/lib64", "/usr/local/Ascend/driver/lib64x"}
+	normalizedFiles, normalizedDirs, removed := NormalizeMountLists(files, dirs)
+	expectFiles := []string{"/etc/hdcBasic.cfg", "/usr/local/Ascend/driver/lib64-extra.so"}
+	expectDirs := []string{"/usr/local/Ascend/driver/lib64", "/usr/local/Ascend/driver/lib64x",
+		"/usr/local/Ascend/driver/tools"}
+	if !reflect.DeepEqual(normalizedFiles, expectFiles) || !reflect.DeepEqual(normalizedDirs, expectDirs) {
+		t.Fatalf("unexpected result %v %v", normalizedFiles, normalizedDirs)
+	}
+	if removed != len(files)+len(dirs)-len(expectFiles)-len(expectDirs) {
+		t.Fatalf("unexpected removed count %d", removed)
+	}
+}
@@ -0,0 +1,165 @@
+/* Copyright(C) 2022. Huawei Technologies Co.,Ltd. All rights reserved.
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Package mindxcheckutils
+package mindxcheckutils
+
+import (
+	"bufio"
+	"fmt"
+	"os"
+	"path/filepath"
+	"sort"
+	"strings"
+)
+
+const (
+	// MountProfileDir is the dir of the mount profiles shared by ascend-docker-hook and ascend-docker-runtime
+	MountProfileDir = "/etc/ascend-docker-runtime.d"
+	// BaseMountProfile is the profile used when ASCEND_RUNTIME_MOUNTS is not given
+	BaseMountProfile = "base"
+	// MountProfileSuffix is the file suffix of the mount profiles
+	MountProfileSuffix = "list"
+
+	maxMountsLength     = 128
+	maxMountEntryNumber = 128
+)
+
+// ParseMountProfiles splits the value of ASCEND_RUNTIME_MOUNTS into profile names
+func ParseMountProfiles(mounts string) []string {
+	if mounts == "" || len(mounts) > maxMountsLength {
+		return []string{BaseMountProfile}
+	}
+	profiles := make([]string, 0)
+	for _, m := range strings.Split(mounts, ",") {
+		profiles = append(profiles, strings.ToLower(strings.TrimSpace(m)))
+	}
+	return profiles
+}
+
+// MountProfilePath returns the path of the profile name in dir
+func MountProfilePath(dir string, name string) string {
+	return filepath.Join(dir, fmt.Sprintf("%s.%s", name, MountProfileSuffix))
+}
+
+func readMountProfile(dir string, name string) ([]string, []string, error) {
+	if name == "" || strings.Contains(name, "/") {
+		return nil, nil, fmt.Errorf("invalid mount profile name %s", name)
+	}
+	profilePath, err := filepath.Abs(MountProfilePath(dir, name))
+	if err != nil {
+		return nil, nil, fmt.Errorf("failed to assemble mount profile path: %v", err)
+	}
+	realPath, err := RealFileChecker(profilePath, true, false, DefaultSize)
+	if err != nil {
+		return nil, nil, err
+	}
+	f, err := os.Open(realPath)
+	if err != nil {
+		return nil, nil, fmt.Errorf("failed to open mount profile %s: %v", realPath, err)
+	}
+	defer f.Close()
+
+	fileMountList, dirMountList := make([]string, 0), make([]string, 0)
+	entryCount := 0
+	scanner := bufio.NewScanner(f)
+	for scanner.Scan() {
+		entryCount++
+		if entryCount > maxMountEntryNumber {
+			return nil, nil, fmt.Errorf("mount list too long")
+		}
+		mountPath, err := filepath.Abs(scanner.Text())
+		if err != nil {
+			continue // skipping files/dirs with any problems
+		}
+		stat, err := os.Stat(mountPath)
+		if err != nil {
+			continue // skipping files/dirs with any problems
+		}
+		if stat.Mode().IsRegular() {
+			fileMountList = append(fileMountList, mountPath)
+		} else if stat.Mode().IsDir() {
+			dirMountList = append(dirMountList, mountPath)
+		}
+	}
+	return fileMountList, dirMountList, nil
+}
+
+// ReadMountProfiles reads the profiles in dir, and returns the files and the dirs listed in them,
+// entries which can not be stat are skipped
+func ReadMountProfiles(dir string, names []string) ([]string, []string, error) {
+	fileInfo, err := os.Stat(dir)
+	if err != nil {
+		return nil, nil, fmt.Errorf("cannot stat configuration directory %s : %v", dir, err)
+	}
+	if !fileInfo.Mode().IsDir() {
+		return nil, nil, fmt.Errorf("%s should be a dir for ascend docker runtime, but now it is not", dir)
+	}
+
+	fileMountList, dirMountList := make([]string, 0), make([]string, 0)
+	for _, name := range names {
+		files, dirs, err := readMountProfile(dir, name)
+		if err != nil {
+			return nil, nil, fmt.Errorf("failed to process config %s: %v", name, err)
+		}
+		fileMountList = append(fileMountList, files...)
+		dirMountList = append(dirMountList, dirs...)
+	}
+	return fileMountList, dirMountList, nil
+}
+
+// isCoveredByDir reports whether one of the ancestors of mountPath is in dirSet
+func isCoveredByDir(mountPath string, dirSet map[string]struct{}) bool {
+	for parent := filepath.Dir(mountPath); ; parent = filepath.Dir(parent) {
+		if _, ok := dirSet[parent]; ok {
+			return true
+		}
+		if parent == filepath.Dir(parent) {
+			return false
+		}
+	}
+}
+
+// NormalizeMountLists removes duplicated entries and entries already covered by a listed parent dir,
+// the results are sorted so that the mount table layout is stable, the number of removed entries is returned
+func NormalizeMountLists(fileMountList []string, dirMountList []string) ([]string, []string, int) {
+	dirs := append([]string{}, dirMountList...)
+	sort.Strings(dirs)
+	dirSet := make(map[string]struct{}, len(dirs))
+	normalizedDirs := make([]string, 0, len(dirs))
+	for _, dir := range dirs {
+		if _, ok := dirSet[dir]; ok {
+			continue
+		}
+		dirSet[dir] = struct{}{}
+		if !isCoveredByDir(dir, dirSet) {
+			normalizedDirs = append(normalizedDirs, dir)
+		}
+	}
+
+	files := append([]string{}, fileMountList...)
+	sort.Strings(files)
+	normalizedFiles := make([]string, 0, len(files))
+	for i, file := range files {
+		if i > 0 && file == files[i-1] {
+			continue
+		}
+		if !isCoveredByDir(file, dirSet) {
+			normalizedFiles = append(normalizedFiles, file)
+		}
+	}
+
+	removed := len(fileMountList) + len(dirMountList) - len(normalizedFiles) - len(normalizedDirs)
+	return normalizedFiles, normalizedDirs, removed
+}
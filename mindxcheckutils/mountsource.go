@@ -0,0 +1,117 @@
+/* Copyright(C) 2022. Huawei Technologies Co.,Ltd. All rights reserved.
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Package mindxcheckutils
+package mindxcheckutils
+
+import (
+	"fmt"
+	"io/fs"
+	"path/filepath"
+	"syscall"
+)
+
+const (
+	// OPath is O_PATH, not exported by package syscall
+	OPath             = 0x200000
+	procSelfFd        = "/proc/self/fd"
+	maxSourceFileSize = 10 * 1024 // in megabytes, same limit as ascend-docker-cli
+	maxSubsetFileSize = 150       // in megabytes, limit of files inside a mounted dir
+	maxSourceDepth    = 99
+)
+
+func checkSourceMode(stat *syscall.Stat_t, name string) error {
+	if stat.Mode&(syscall.S_IWGRP|syscall.S_IWOTH) != 0 {
+		return fmt.Errorf("write permission not right %v", name)
+	}
+	return nil
+}
+
+// checkSourceParents walks up from fd by "..", so the checked parents are the ones the fd really lives in
+func checkSourceParents(fd int, stat syscall.Stat_t, name string) error {
+	current := fd
+	defer func() {
+		if current != fd {
+			syscall.Close(current)
+		}
+	}()
+	for depth := 0; depth < maxSourceDepth; depth++ {
+		if err := checkSourceMode(&stat, name); err != nil {
+			return err
+		}
+		parent, err := syscall.Openat(current, "..", OPath|syscall.O_DIRECTORY|syscall.O_CLOEXEC, 0)
+		if err != nil {
+			return fmt.Errorf("failed to open parent of %s: %v", name, err)
+		}
+		if current != fd {
+			syscall.Close(current)
+		}
+		current = parent
+		var parentStat syscall.Stat_t
+		if err := syscall.Fstat(current, &parentStat); err != nil {
+			return fmt.Errorf("failed to stat parent of %s: %v", name, err)
+		}
+		if parentStat.Dev == stat.Dev && parentStat.Ino == stat.Ino {
+			return nil // reached "/"
+		}
+		stat = parentStat
+	}
+	return fmt.Errorf("path of %s is too deep", name)
+}
+
+func checkSourceSubset(fd int, name string, allowLink bool) error {
+	// the trailing slash makes WalkDir start from the dir behind the fd instead of the proc link
+	root := fmt.Sprintf("%s/%d/", procSelfFd, fd)
+	return filepath.WalkDir(root, func(filePath string, entry fs.DirEntry, err error) error {
+		if err != nil {
+			return fmt.Errorf("failed to walk %s: %v", name, err)
+		}
+		if entry.Type()&fs.ModeSymlink != 0 && !allowLink {
+			return fmt.Errorf("%s has a soft link", name)
+		}
+		if !entry.Type().IsRegular() {
+			return nil
+		}
+		info, err := entry.Info()
+		if err != nil {
+			return fmt.Errorf("failed to stat file in %s: %v", name, err)
+		}
+		if info.Size() >= maxSubsetFileSize*oneMegabytes {
+			return fmt.Errorf("file size in %s out of bounds", name)
+		}
+		return nil
+	})
+}
+
+// MountSourceChecker applies the mount source policy of ascend-docker-cli on a mount source opened by O_PATH
+func MountSourceChecker(fd int, name string, allowLink bool) error {
+	var stat syscall.Stat_t
+	if err := syscall.Fstat(fd, &stat); err != nil {
+		return fmt.Errorf("failed to stat %s: %v", name, err)
+	}
+	fileType := stat.Mode & syscall.S_IFMT
+	if fileType != syscall.S_IFREG && fileType != syscall.S_IFDIR {
+		return fmt.Errorf("%s is not a regular file or dir", name)
+	}
+	if fileType == syscall.S_IFREG && stat.Size >= maxSourceFileSize*oneMegabytes {
+		return fmt.Errorf("file size of %s out of bounds", name)
+	}
+	if err := checkSourceParents(fd, stat, name); err != nil {
+		return err
+	}
+	if fileType == syscall.S_IFDIR {
+		return checkSourceSubset(fd, name, allowLink)
+	}
+	return nil
+}
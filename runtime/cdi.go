@@ -0,0 +1,304 @@
+/* Copyright(C) 2022. Huawei Technologies Co.,Ltd. All rights reserved.
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Package main
+package main
+
+import (
+	"crypto/sha256"
+	"encoding/hex"
+	"encoding/json"
+	"fmt"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"regexp"
+	"sort"
+	"strconv"
+	"syscall"
+
+	"github.com/opencontainers/runtime-spec/specs-go"
+	"huawei.com/npu-exporter/v5/common-utils/hwlog"
+
+	"mindxcheckutils"
+)
+
+const (
+	generateCdiCmd       = "generate-cdi"
+	cdiOutputArg         = "--output"
+	cdiDefaultOutputPath = "/etc/cdi/ascend-npu.json"
+	cdiVersion           = "0.6.0"
+	cdiKind              = "ascend.com/npu"
+	cdiAllDevices        = "all"
+	cdiFingerprintKey    = "ascend.com/fingerprint"
+	cdiFormatVersion     = "1"
+	cdiOutputMode        = 0644
+	cdiOutputDirMode     = 0755
+	driverVersionFile    = "/usr/local/Ascend/driver/version.info"
+)
+
+var davinciNameRegexp = regexp.MustCompile(`^davinci([0-9]+)$`)
+
+type cdiDeviceNode struct {
+	Path        string       `json:"path"`
+	Type        string       `json:"type,omitempty"`
+	Major       int64        `json:"major,omitempty"`
+	Minor       int64        `json:"minor,omitempty"`
+	FileMode    *os.FileMode `json:"fileMode,omitempty"`
+	Permissions string       `json:"permissions,omitempty"`
+	UID         *uint32      `json:"uid,omitempty"`
+	GID         *uint32      `json:"gid,omitempty"`
+}
+
+type cdiMount struct {
+	HostPath      string   `json:"hostPath"`
+	ContainerPath string   `json:"containerPath"`
+	Type          string   `json:"type,omitempty"`
+	Options       []string `json:"options,omitempty"`
+}
+
+type cdiContainerEdits struct {
+	DeviceNodes []cdiDeviceNode `json:"deviceNodes,omitempty"`
+	Mounts      []cdiMount      `json:"mounts,omitempty"`
+}
+
+type cdiDevice struct {
+	Name           string            `json:"name"`
+	ContainerEdits cdiContainerEdits `json:"containerEdits"`
+}
+
+type cdiSpec struct {
+	Version        string            `json:"cdiVersion"`
+	Kind           string            `json:"kind"`
+	Annotations    map[string]string `json:"annotations,omitempty"`
+	Devices        []cdiDevice       `json:"devices"`
+	ContainerEdits cdiContainerEdits `json:"containerEdits"`
+}
+
+func getCdiOutput(cmdArgs []string) (string, error) {
+	output := cdiDefaultOutputPath
+	for i := 0; i < len(cmdArgs); i++ {
+		if cmdArgs[i] != cdiOutputArg || i+1 >= len(cmdArgs) {
+			return "", fmt.Errorf("usage: %s [%s <path>]", generateCdiCmd, cdiOutputArg)
+		}
+		i++
+		output = cmdArgs[i]
+	}
+	if !filepath.IsAbs(output) {
+		return "", fmt.Errorf("cdi output should be an absolute path: %s", output)
+	}
+	return filepath.Clean(output), nil
+}
+
+// listDavinciDevices returns the ids of the davinciN nodes under /dev in ascending order
+func listDavinciDevices(devDir string) ([]int, error) {
+	entries, err := ioutil.ReadDir(devDir)
+	if err != nil {
+		return nil, fmt.Errorf("failed to read %s: %v", devDir, err)
+	}
+	ids := make([]int, 0)
+	for _, entry := range entries {
+		matches := davinciNameRegexp.FindStringSubmatch(entry.Name())
+		if matches == nil || entry.Mode()&os.ModeCharDevice == 0 {
+			continue
+		}
+		id, err := strconv.Atoi(matches[1])
+		if err != nil {
+			continue
+		}
+		ids = append(ids, id)
+	}
+	sort.Ints(ids)
+	return ids, nil
+}
+
+// getCdiFingerprint hashes everything the generated spec depends on: the device nodes, the installed driver
+// and the mount profile, so that the spec is only generated again on topology or driver change
+func getCdiFingerprint(devDir string, deviceIds []int, extraFiles []string) string {
+	hash := sha256.New()
+	hash.Write([]byte(cdiFormatVersion + "\n"))
+	for _, id := range deviceIds {
+		var stat syscall.Stat_t
+		name := davinciName + strconv.Itoa(id)
+		if err := syscall.Stat(filepath.Join(devDir, name), &stat); err == nil {
+			hash.Write([]byte(fmt.Sprintf("%s %d\n", name, stat.Rdev)))
+		}
+	}
+	for _, file := range extraFiles {
+		hash.Write([]byte(file + "\n"))
+		if content, err := ioutil.ReadFile(file); err == nil {
+			hash.Write(content)
+		}
+	}
+	return hex.EncodeToString(hash.Sum(nil))
+}
+
+// readCdiFingerprint returns the fingerprint recorded in a generated spec, or "" if there is none
+func readCdiFingerprint(output string) string {
+	if _, err := os.Stat(output); err != nil {
+		return ""
+	}
+	realPath, err := mindxcheckutils.RealFileChecker(output, true, false, mindxcheckutils.DefaultSize)
+	if err != nil {
+		hwlog.RunLog.Warnf("cached cdi spec check failed, generate it again: %v", err)
+		return ""
+	}
+	content, err := ioutil.ReadFile(realPath)
+	if err != nil {
+		return ""
+	}
+	spec := cdiSpec{}
+	if err := json.Unmarshal(content, &spec); err != nil || spec.Kind != cdiKind {
+		return ""
+	}
+	return spec.Annotations[cdiFingerprintKey]
+}
+
+func toCdiDeviceNodes(devices []specs.LinuxDevice) []cdiDeviceNode {
+	nodes := make([]cdiDeviceNode, 0, len(devices))
+	for _, device := range devices {
+		nodes = append(nodes, cdiDeviceNode{
+			Path:        device.Path,
+			Type:        device.Type,
+			Major:       device.Major,
+			Minor:       device.Minor,
+			FileMode:    device.FileMode,
+			Permissions: "rwm",
+			UID:         device.UID,
+			GID:         device.GID,
+		})
+	}
+	return nodes
+}
+
+func toCdiMounts(mounts []specs.Mount) []cdiMount {
+	cdiMounts := make([]cdiMount, 0, len(mounts))
+	for _, m := range mounts {
+		cdiMounts = append(cdiMounts, cdiMount{
+			HostPath:      m.Source,
+			ContainerPath: m.Destination,
+			Type:          m.Type,
+			Options:       m.Options,
+		})
+	}
+	return cdiMounts
+}
+
+func newDeviceSpec() *specs.Spec {
+	return &specs.Spec{Linux: &specs.Linux{Resources: &specs.LinuxResources{}}}
+}
+
+// buildCdiSpec describes every davinciN as a CDI device, the manager devices and the driver mounts are
+// common edits applied whichever devices are requested
+func buildCdiSpec(deviceIds []int, fingerprint string) (*cdiSpec, error) {
+	cdi := &cdiSpec{
+		Version:     cdiVersion,
+		Kind:        cdiKind,
+		Annotations: map[string]string{cdiFingerprintKey: fingerprint},
+		Devices:     make([]cdiDevice, 0, len(deviceIds)+1),
+	}
+	allDevices := newDeviceSpec()
+	for _, id := range deviceIds {
+		deviceSpec := newDeviceSpec()
+		if err := addDeviceToSpec(deviceSpec, devicePath+davinciName+strconv.Itoa(id), davinciName); err != nil {
+			return nil, fmt.Errorf("failed to add davinci device to cdi spec: %v", err)
+		}
+		allDevices.Linux.Devices = append(allDevices.Linux.Devices, deviceSpec.Linux.Devices...)
+		cdi.Devices = append(cdi.Devices, cdiDevice{
+			Name:           strconv.Itoa(id),
+			ContainerEdits: cdiContainerEdits{DeviceNodes: toCdiDeviceNodes(deviceSpec.Linux.Devices)},
+		})
+	}
+	cdi.Devices = append(cdi.Devices, cdiDevice{
+		Name:           cdiAllDevices,
+		ContainerEdits: cdiContainerEdits{DeviceNodes: toCdiDeviceNodes(allDevices.Linux.Devices)},
+	})
+
+	managerSpec := newDeviceSpec()
+	if err := addManagerDevice(managerSpec); err != nil {
+		return nil, fmt.Errorf("failed to add manager device to cdi spec: %v", err)
+	}
+	sources, err := readDriverMountSources("", false)
+	if err != nil {
+		return nil, fmt.Errorf("failed to read driver mounts: %v", err)
+	}
+	cdi.ContainerEdits = cdiContainerEdits{
+		DeviceNodes: toCdiDeviceNodes(managerSpec.Linux.Devices),
+		Mounts:      toCdiMounts(buildSpecMounts(nil, sources)),
+	}
+	return cdi, nil
+}
+
+func writeCdiSpec(output string, cdi *cdiSpec) error {
+	content, err := json.MarshalIndent(cdi, "", "  ")
+	if err != nil {
+		return fmt.Errorf("failed to marshal cdi spec: %v", err)
+	}
+	if err := os.MkdirAll(filepath.Dir(output), cdiOutputDirMode); err != nil {
+		return fmt.Errorf("failed to create dir of %s: %v", output, err)
+	}
+	// engines may read the dir at any time, so the spec is replaced by rename
+	tmpFile, err := ioutil.TempFile(filepath.Dir(output), "."+filepath.Base(output))
+	if err != nil {
+		return fmt.Errorf("failed to create temp file for %s: %v", output, err)
+	}
+	defer os.Remove(tmpFile.Name())
+	if _, err := tmpFile.Write(content); err != nil {
+		tmpFile.Close()
+		return fmt.Errorf("failed to write %s: %v", tmpFile.Name(), err)
+	}
+	if err := tmpFile.Chmod(cdiOutputMode); err != nil {
+		tmpFile.Close()
+		return fmt.Errorf("failed to chmod %s: %v", tmpFile.Name(), err)
+	}
+	if err := tmpFile.Close(); err != nil {
+		return fmt.Errorf("failed to close %s: %v", tmpFile.Name(), err)
+	}
+	if err := os.Rename(tmpFile.Name(), output); err != nil {
+		return fmt.Errorf("failed to rename to %s: %v", output, err)
+	}
+	return nil
+}
+
+// generateCdi writes the CDI spec of the Ascend devices of this node, nothing is done if the cached spec
+// was generated from the same devices, driver and mount profile
+func generateCdi(cmdArgs []string) error {
+	output, err := getCdiOutput(cmdArgs)
+	if err != nil {
+		return err
+	}
+	deviceIds, err := listDavinciDevices(devicePath)
+	if err != nil {
+		return err
+	}
+	if len(deviceIds) == 0 {
+		return fmt.Errorf("no davinci device found in %s", devicePath)
+	}
+	baseProfile := mindxcheckutils.MountProfilePath(mountConfigDir, mindxcheckutils.BaseMountProfile)
+	fingerprint := getCdiFingerprint(devicePath, deviceIds, []string{driverVersionFile, baseProfile})
+	if readCdiFingerprint(output) == fingerprint {
+		hwlog.RunLog.Infof("cdi spec %s is up to date", output)
+		return nil
+	}
+
+	cdi, err := buildCdiSpec(deviceIds, fingerprint)
+	if err != nil {
+		return err
+	}
+	if err := writeCdiSpec(output, cdi); err != nil {
+		return err
+	}
+	hwlog.RunLog.Infof("cdi spec %s generated with %d devices", output, len(deviceIds))
+	return nil
+}
@@ -0,0 +1,153 @@
+/* Copyright(C) 2022. Huawei Technologies Co.,Ltd. All rights reserved.
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Package main
+package main
+
+import (
+	"os"
+	"strconv"
+	"strings"
+
+	"github.com/opencontainers/runtime-spec/specs-go"
+)
+
+const (
+	cgroupWildcardKey = "cgroup-wildcard"
+	cgroupRuleAccess  = "rwm"
+	sysCharDevDir     = "/sys/dev/char"
+	sysBlockDevDir    = "/sys/dev/block"
+)
+
+var sysDevDirs = map[string]string{charDeviceType: sysCharDevDir, blockDeviceType: sysBlockDevDir}
+
+type deviceMajor struct {
+	devType string
+	major   int64
+}
+
+// readRegisteredMinors returns the minors of every device the kernel registered for each major, sysfs lists
+// them as "major:minor" whether or not a node exists in /dev
+func readRegisteredMinors(dirs map[string]string) map[deviceMajor]map[int64]struct{} {
+	registered := make(map[deviceMajor]map[int64]struct{})
+	for devType, dir := range dirs {
+		f, err := os.Open(dir)
+		if err != nil {
+			continue
+		}
+		names, err := f.Readdirnames(-1)
+		f.Close()
+		if err != nil {
+			continue
+		}
+		for _, name := range names {
+			words := strings.SplitN(name, ":", kvPairSize)
+			if len(words) != kvPairSize {
+				continue
+			}
+			major, err := strconv.ParseInt(words[0], 10, 64)
+			if err != nil {
+				continue
+			}
+			minor, err := strconv.ParseInt(words[1], 10, 64)
+			if err != nil {
+				continue
+			}
+			key := deviceMajor{devType: devType, major: major}
+			if registered[key] == nil {
+				registered[key] = make(map[int64]struct{})
+			}
+			registered[key][minor] = struct{}{}
+		}
+	}
+	return registered
+}
+
+func isNodeRule(rule specs.LinuxDeviceCgroup) bool {
+	return rule.Allow && rule.Major != nil && rule.Minor != nil && rule.Access == cgroupRuleAccess &&
+		(rule.Type == charDeviceType || rule.Type == blockDeviceType)
+}
+
+// coalesceDeviceCgroups replaces the rules of a major by one rule with a wildcard minor when the rules grant
+// every device registered with that major, so the allowed devices stay the same, the wildcard rule takes the
+// place of the first rule of the major
+func coalesceDeviceCgroups(rules []specs.LinuxDeviceCgroup,
+	registered map[deviceMajor]map[int64]struct{}) []specs.LinuxDeviceCgroup {
+	granted := make(map[deviceMajor]map[int64]struct{})
+	for _, rule := range rules {
+		if !isNodeRule(rule) {
+			continue
+		}
+		key := deviceMajor{devType: rule.Type, major: *rule.Major}
+		if granted[key] == nil {
+			granted[key] = make(map[int64]struct{})
+		}
+		granted[key][*rule.Minor] = struct{}{}
+	}
+
+	wildcard := make(map[deviceMajor]bool)
+	for key, minors := range granted {
+		all, ok := registered[key]
+		if !ok || len(all) == 0 {
+			continue
+		}
+		covered := true
+		for minor := range all {
+			if _, ok := minors[minor]; !ok {
+				covered = false
+				break
+			}
+		}
+		wildcard[key] = covered
+	}
+
+	coalesced := make([]specs.LinuxDeviceCgroup, 0, len(rules))
+	added := make(map[deviceMajor]bool)
+	for _, rule := range rules {
+		if !isNodeRule(rule) {
+			coalesced = append(coalesced, rule)
+			continue
+		}
+		key := deviceMajor{devType: rule.Type, major: *rule.Major}
+		if !wildcard[key] {
+			coalesced = append(coalesced, rule)
+			continue
+		}
+		if added[key] {
+			continue
+		}
+		added[key] = true
+		major := key.major
+		coalesced = append(coalesced, specs.LinuxDeviceCgroup{
+			Allow:  true,
+			Type:   key.devType,
+			Major:  &major,
+			Access: cgroupRuleAccess,
+		})
+	}
+	return coalesced
+}
+
+// coalesceAddedDeviceCgroups coalesces the rules from index start on, the ones added by ascend-docker-runtime,
+// the rules which were already in the spec are kept as they are
+func coalesceAddedDeviceCgroups(spec *specs.Spec, start int) {
+	if spec.Linux == nil || spec.Linux.Resources == nil || start >= len(spec.Linux.Resources.Devices) {
+		return
+	}
+	added := coalesceDeviceCgroups(spec.Linux.Resources.Devices[start:], readRegisteredMinors(sysDevDirs))
+	spec.Linux.Resources.Devices = spec.Linux.Resources.Devices[:start]
+	for _, rule := range added {
+		appendDeviceCgroup(spec, rule)
+	}
+}
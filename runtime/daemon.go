@@ -0,0 +1,460 @@
+/* Copyright(C) 2022. Huawei Technologies Co.,Ltd. All rights reserved.
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Package main
+package main
+
+import (
+	"encoding/json"
+	"errors"
+	"fmt"
+	"io"
+	"net"
+	"os"
+	"os/signal"
+	"path/filepath"
+	"sync"
+	"syscall"
+	"time"
+
+	"github.com/opencontainers/runtime-spec/specs-go"
+	"huawei.com/npu-exporter/v5/common-utils/hwlog"
+
+	"main/dcmi"
+)
+
+const (
+	daemonCmd            = "daemon"
+	daemonSocketPath     = "/run/ascend-docker-runtime/runtimed.sock"
+	stateDirMode         = 0700
+	daemonSocketMode     = 0600
+	daemonDialTimeout    = 100 * time.Millisecond
+	daemonRequestTimeout = 60 * time.Second
+	maxDaemonRequestSize = 1024 * 1024
+
+	opChipName       = "chip-name"
+	opProductType    = "product-type"
+	opCreateVDevice  = "create-vdevice"
+	opDestroyVDevice = "destroy-vdevice"
+	opReleaseVDevice = "release-vdevice"
+)
+
+var (
+	daemonSocket     = daemonSocketPath
+	errDaemonAbsent  = errors.New("runtime daemon is not running")
+	errDaemonStopped = errors.New("runtime daemon stopped")
+)
+
+// daemonRequest is one request of the runtime to the daemon, one request is sent per connection
+type daemonRequest struct {
+	Op      string            `json:"op"`
+	Env     []string          `json:"env,omitempty"`
+	Devices []int             `json:"devices,omitempty"`
+	VDevice *dcmi.VDeviceInfo `json:"vdevice,omitempty"`
+	Lease   string            `json:"lease,omitempty"`
+}
+
+type daemonResponse struct {
+	Value   string            `json:"value,omitempty"`
+	VDevice *dcmi.VDeviceInfo `json:"vdevice,omitempty"`
+	Error   string            `json:"error,omitempty"`
+}
+
+// dcmiBackend is what the daemon asks the driver, tests replace it with a fake one
+type dcmiBackend interface {
+	ChipName() (string, error)
+	ProductType() (string, error)
+	CreateVDevice(spec *specs.Spec, devices []int) (dcmi.VDeviceInfo, error)
+	DestroyVDevice(vdevice dcmi.VDeviceInfo) error
+}
+
+// sessionWorker keeps one dcmi session open for the daemon, the session is not opened and closed per request
+type sessionWorker struct {
+	dcmi.NpuWorker
+}
+
+// Initialize does nothing, the session is opened when the daemon starts
+func (w *sessionWorker) Initialize() error {
+	return nil
+}
+
+// ShutDown does nothing, the session is closed when the daemon stops
+func (w *sessionWorker) ShutDown() {}
+
+type driverBackend struct {
+	worker sessionWorker
+}
+
+func newDriverBackend() (*driverBackend, error) {
+	backend := &driverBackend{}
+	if err := backend.worker.NpuWorker.Initialize(); err != nil {
+		return nil, fmt.Errorf("cannot init dcmi : %v", err)
+	}
+	return backend, nil
+}
+
+func (b *driverBackend) close() {
+	b.worker.NpuWorker.ShutDown()
+}
+
+// ChipName get name of chip
+func (b *driverBackend) ChipName() (string, error) {
+	return dcmi.GetChipNameByWorker(&b.worker)
+}
+
+// ProductType get type of product
+func (b *driverBackend) ProductType() (string, error) {
+	return dcmi.GetProductType(&b.worker)
+}
+
+// CreateVDevice create virtual device
+func (b *driverBackend) CreateVDevice(spec *specs.Spec, devices []int) (dcmi.VDeviceInfo, error) {
+	return dcmi.CreateVDevice(&b.worker, spec, devices)
+}
+
+// DestroyVDevice destroy virtual device
+func (b *driverBackend) DestroyVDevice(vdevice dcmi.VDeviceInfo) error {
+	return b.worker.DestroyVDevice(vdevice.CardID, vdevice.DeviceID, vdevice.VdeviceID)
+}
+
+// cachedDcmiQuery remembers the first successful answer of query, failures are not remembered so that a
+// driver loaded later is still picked up
+func cachedDcmiQuery(query func() (string, error)) func() (string, error) {
+	var mu sync.Mutex
+	value, cached := "", false
+	return func() (string, error) {
+		mu.Lock()
+		defer mu.Unlock()
+		if cached {
+			return value, nil
+		}
+		result, err := query()
+		if err != nil {
+			return "", err
+		}
+		value, cached = result, true
+		return value, nil
+	}
+}
+
+// runtimeDaemon answers the driver questions of ascend-docker-runtime, the chip name and product type are
+// read once, and the vNPUs created through it are kept in a ledger with the pool they may go back to and the
+// lease of their container
+type runtimeDaemon struct {
+	// dcmi is not known to be thread safe, requests are handled one by one
+	mu          sync.Mutex
+	backend     dcmiBackend
+	chipName    func() (string, error)
+	productType func() (string, error)
+	ledger      map[dcmi.VDeviceInfo]ledgerEntry
+	pool        *vnpuPool
+	leases      map[string]vnpuLease
+	leaseTTL    time.Duration
+	queue       *destroyQueue
+	// idleDir records the pooled and leased vNPUs on disk, empty if they are only kept in memory
+	idleDir string
+	now     func() time.Time
+}
+
+func newRuntimeDaemon(backend dcmiBackend, poolTargets map[poolKey]int, leaseTTL time.Duration) *runtimeDaemon {
+	return &runtimeDaemon{
+		backend:     backend,
+		chipName:    cachedDcmiQuery(backend.ChipName),
+		productType: cachedDcmiQuery(backend.ProductType),
+		ledger:      make(map[dcmi.VDeviceInfo]ledgerEntry),
+		pool:        newVnpuPool(poolTargets),
+		leases:      make(map[string]vnpuLease),
+		leaseTTL:    leaseTTL,
+		now:         time.Now,
+	}
+}
+
+func (d *runtimeDaemon) createVDevice(req daemonRequest) (dcmi.VDeviceInfo, error) {
+	start := time.Now()
+	key, pooled := getPoolKey(req.Env, req.Devices)
+	entry := ledgerEntry{pool: key}
+	if pooled && d.leaseTTL > 0 && req.Lease != "" {
+		entry.lease = req.Lease
+		if vdevice, ok := d.takeLease(req.Lease, key); ok {
+			hwlog.RunLog.Infof("vNPU lease %s hit, vNPU %v reused in %v", req.Lease, vdevice, time.Since(start))
+			d.ledger[vdevice] = entry
+			return vdevice, nil
+		}
+	}
+	if pooled {
+		if vdevice, ok := d.pool.lease(key); ok {
+			d.unmarkIdle(vdevice)
+			hwlog.RunLog.Infof("vNPU %v of %v leased from the pool in %v", vdevice, key, time.Since(start))
+			d.ledger[vdevice] = entry
+			return vdevice, nil
+		}
+	}
+	vdevice, err := d.backend.CreateVDevice(&specs.Spec{Process: &specs.Process{Env: req.Env}}, req.Devices)
+	if err == nil && vdevice.VdeviceID != -1 {
+		d.ledger[vdevice] = entry
+		if entry.lease != "" {
+			hwlog.RunLog.Infof("vNPU lease %s missed, vNPU %v split in %v", req.Lease, vdevice, time.Since(start))
+		}
+	}
+	return vdevice, err
+}
+
+func (d *runtimeDaemon) handle(req daemonRequest) daemonResponse {
+	d.mu.Lock()
+	defer d.mu.Unlock()
+
+	var err error
+	resp := daemonResponse{}
+	switch req.Op {
+	case opChipName:
+		resp.Value, err = d.chipName()
+	case opProductType:
+		resp.Value, err = d.productType()
+	case opCreateVDevice:
+		var vdevice dcmi.VDeviceInfo
+		if vdevice, err = d.createVDevice(req); err == nil {
+			resp.VDevice = &vdevice
+		}
+	case opDestroyVDevice:
+		if req.VDevice == nil {
+			err = fmt.Errorf("no vdevice to destroy")
+			break
+		}
+		if err = d.backend.DestroyVDevice(*req.VDevice); err == nil {
+			delete(d.ledger, *req.VDevice)
+		}
+	case opStatus:
+		resp.Value, err = d.status()
+	case opReleaseVDevice:
+		if req.VDevice == nil {
+			err = fmt.Errorf("no vdevice to release")
+			break
+		}
+		err = d.releaseVDevice(*req.VDevice)
+	default:
+		err = fmt.Errorf("unknown op %s", req.Op)
+	}
+	if err != nil {
+		resp.Error = err.Error()
+	}
+	return resp
+}
+
+func (d *runtimeDaemon) serveConn(conn net.Conn) {
+	defer conn.Close()
+	if err := conn.SetDeadline(time.Now().Add(daemonRequestTimeout)); err != nil {
+		return
+	}
+	req := daemonRequest{}
+	if err := json.NewDecoder(io.LimitReader(conn, maxDaemonRequestSize)).Decode(&req); err != nil {
+		hwlog.RunLog.Warnf("invalid daemon request: %v", err)
+		return
+	}
+	if err := json.NewEncoder(conn).Encode(d.handle(req)); err != nil {
+		hwlog.RunLog.Warnf("failed to answer daemon request %s: %v", req.Op, err)
+	}
+}
+
+func (d *runtimeDaemon) serve(listener net.Listener) error {
+	for {
+		conn, err := listener.Accept()
+		if err != nil {
+			return err
+		}
+		go d.serveConn(conn)
+	}
+}
+
+// checkStateDir makes sure only root can change a dir of the runtime state, the daemon socket, the destroy queue
+// and the device cache all decide what a container gets
+func checkStateDir(dir string) error {
+	var stat syscall.Stat_t
+	if err := syscall.Lstat(dir, &stat); err != nil {
+		return err
+	}
+	if stat.Mode&syscall.S_IFMT != syscall.S_IFDIR || stat.Uid != uint32(os.Geteuid()) ||
+		stat.Mode&(syscall.S_IWGRP|syscall.S_IWOTH) != 0 {
+		return fmt.Errorf("invalid runtime state dir %s", dir)
+	}
+	return nil
+}
+
+// makeStateDir creates dir if it does not exist yet and checks it
+func makeStateDir(dir string) error {
+	if err := os.MkdirAll(dir, stateDirMode); err != nil {
+		return fmt.Errorf("failed to create %s: %v", dir, err)
+	}
+	return checkStateDir(dir)
+}
+
+func listenDaemonSocket(socketPath string) (net.Listener, error) {
+	dir := filepath.Dir(socketPath)
+	if err := makeStateDir(dir); err != nil {
+		return nil, err
+	}
+	// a socket left by a daemon which did not stop cleanly
+	if err := os.Remove(socketPath); err != nil && !os.IsNotExist(err) {
+		return nil, fmt.Errorf("failed to remove %s: %v", socketPath, err)
+	}
+	listener, err := net.Listen("unix", socketPath)
+	if err != nil {
+		return nil, fmt.Errorf("failed to listen on %s: %v", socketPath, err)
+	}
+	if err := os.Chmod(socketPath, daemonSocketMode); err != nil {
+		listener.Close()
+		return nil, fmt.Errorf("failed to chmod %s: %v", socketPath, err)
+	}
+	return listener, nil
+}
+
+// runDaemon serves the runtime until SIGTERM or SIGINT, one dcmi session is kept open meanwhile
+func runDaemon(cmdArgs []string) error {
+	if len(cmdArgs) != 0 {
+		return fmt.Errorf("usage: %s", daemonCmd)
+	}
+	config, err := getRuntimeConfig()
+	if err != nil {
+		return err
+	}
+	poolTargets, err := parseVnpuPool(config[vnpuPoolKey])
+	if err != nil {
+		return err
+	}
+	leaseTTL, err := parseLeaseTTL(config[vnpuLeaseTTLKey])
+	if err != nil {
+		return err
+	}
+	queue, err := newDestroyQueue(destroyQueueDir)
+	if err != nil {
+		return err
+	}
+	if err := recoverIdleVnpus(idleVnpuDir, queue); err != nil {
+		return err
+	}
+	backend, err := newDriverBackend()
+	if err != nil {
+		return err
+	}
+	defer backend.close()
+	listener, err := listenDaemonSocket(daemonSocket)
+	if err != nil {
+		return err
+	}
+
+	stopped := make(chan os.Signal, 1)
+	signal.Notify(stopped, syscall.SIGTERM, syscall.SIGINT)
+	stopErr := make(chan error, 1)
+	go func() {
+		<-stopped
+		stopErr <- errDaemonStopped
+		listener.Close()
+	}()
+
+	hwlog.RunLog.Infof("runtime daemon listening on %s", daemonSocket)
+	daemon := newRuntimeDaemon(backend, poolTargets, leaseTTL)
+	daemon.queue = queue
+	daemon.idleDir = idleVnpuDir
+	stopWorkers := make(chan struct{})
+	var workers sync.WaitGroup
+	workers.Add(2)
+	go func() {
+		defer workers.Done()
+		daemon.maintainPool(stopWorkers)
+	}()
+	go func() {
+		defer workers.Done()
+		daemon.maintainDestroyQueue(stopWorkers)
+	}()
+	defer func() {
+		close(stopWorkers)
+		workers.Wait()
+		daemon.drainPool()
+		// what still fails stays queued for the next daemon
+		daemon.drainDestroyQueue()
+	}()
+	err = daemon.serve(listener)
+	select {
+	case <-stopErr:
+		hwlog.RunLog.Info("runtime daemon stopped")
+		return nil
+	default:
+		listener.Close()
+		return fmt.Errorf("runtime daemon failed: %v", err)
+	}
+}
+
+// callDaemon sends req to the daemon, errDaemonAbsent is returned if req was not sent at all
+func callDaemon(req daemonRequest) (*daemonResponse, error) {
+	if err := checkStateDir(filepath.Dir(daemonSocket)); err != nil {
+		return nil, errDaemonAbsent
+	}
+	conn, err := net.DialTimeout("unix", daemonSocket, daemonDialTimeout)
+	if err != nil {
+		return nil, errDaemonAbsent
+	}
+	defer conn.Close()
+	if err := conn.SetDeadline(time.Now().Add(daemonRequestTimeout)); err != nil {
+		return nil, errDaemonAbsent
+	}
+	if err := json.NewEncoder(conn).Encode(req); err != nil {
+		return nil, errDaemonAbsent
+	}
+	resp := &daemonResponse{}
+	if err := json.NewDecoder(io.LimitReader(conn, maxDaemonRequestSize)).Decode(resp); err != nil {
+		return nil, fmt.Errorf("invalid answer of runtime daemon: %v", err)
+	}
+	if resp.Error != "" {
+		return nil, fmt.Errorf("runtime daemon: %s", resp.Error)
+	}
+	return resp, nil
+}
+
+func daemonQuery(op string, direct func() (string, error)) func() (string, error) {
+	return func() (string, error) {
+		resp, err := callDaemon(daemonRequest{Op: op})
+		if err != nil {
+			if err != errDaemonAbsent {
+				hwlog.RunLog.Warnf("%v, query dcmi directly", err)
+			}
+			return direct()
+		}
+		return resp.Value, nil
+	}
+}
+
+// useDaemonIfRunning sends the driver questions of this invocation to the runtime daemon, the direct path is
+// taken whenever the daemon cannot be reached
+func useDaemonIfRunning() {
+	getChipName = daemonQuery(opChipName, getChipName)
+	getProductType = daemonQuery(opProductType, getProductType)
+	directCreateVDevice := createVDevice
+	createVDevice = func(spec *specs.Spec, devices []int) (dcmi.VDeviceInfo, error) {
+		resp, err := callDaemon(daemonRequest{Op: opCreateVDevice, Env: spec.Process.Env, Devices: devices,
+			Lease: getLeaseID(spec)})
+		if err == errDaemonAbsent {
+			return directCreateVDevice(spec, devices)
+		}
+		invalidVDevice := dcmi.VDeviceInfo{CardID: -1, DeviceID: -1, VdeviceID: -1}
+		// the daemon got the request, creating again directly may leave two vNPUs behind
+		if err != nil {
+			return invalidVDevice, err
+		}
+		if resp.VDevice == nil {
+			return invalidVDevice, fmt.Errorf("runtime daemon returned no vdevice")
+		}
+		// the daemon may keep the vNPU for another container instead of destroying it
+		releaseThroughDaemon = true
+		return *resp.VDevice, nil
+	}
+}
@@ -74,17 +74,24 @@ func CreateVDevice(w WorkerInterface, spec *specs.Spec, devices []int) (VDeviceI
 	return VDeviceInfo{CardID: targetCardID, DeviceID: targetDeviceID, VdeviceID: vdeviceID}, nil
 }
 
-func extractVpuParam(spec *specs.Spec) (string, error) {
-	allowSplit := map[string]string{
-		"vir01": "vir01", "vir02": "vir02", "vir04": "vir04", "vir08": "vir08", "vir16": "vir16",
-		"vir02_1c": "vir02_1c", "vir03_1c_8g": "vir03_1c_8g", "vir04_3c": "vir04_3c",
-		"vir04_4c_dvpp": "vir04_4c_dvpp", "vir04_3c_ndvpp": "vir04_3c_ndvpp",
-		"vir05_1c_8g": "vir05_1c_8g", "vir05_1c_16g": "vir05_1c_16g",
-		"vir06_1c_16g": "vir06_1c_16g", "vir10_3c_16g": "vir10_3c_16g",
-		"vir10_3c_16g_nm": "vir10_3c_16g_nm", "vir10_3c_32g": "vir10_3c_32g",
-		"vir10_4c_16g_m": "vir10_4c_16g_m", "vir12_3c_32g": "vir12_3c_32g",
-	}
+// allowSplit holds the templates a vNPU can be split with
+var allowSplit = map[string]string{
+	"vir01": "vir01", "vir02": "vir02", "vir04": "vir04", "vir08": "vir08", "vir16": "vir16",
+	"vir02_1c": "vir02_1c", "vir03_1c_8g": "vir03_1c_8g", "vir04_3c": "vir04_3c",
+	"vir04_4c_dvpp": "vir04_4c_dvpp", "vir04_3c_ndvpp": "vir04_3c_ndvpp",
+	"vir05_1c_8g": "vir05_1c_8g", "vir05_1c_16g": "vir05_1c_16g",
+	"vir06_1c_16g": "vir06_1c_16g", "vir10_3c_16g": "vir10_3c_16g",
+	"vir10_3c_16g_nm": "vir10_3c_16g_nm", "vir10_3c_32g": "vir10_3c_32g",
+	"vir10_4c_16g_m": "vir10_4c_16g_m", "vir12_3c_32g": "vir12_3c_32g",
+}
+
+// IsValidVpuTemplate reports whether a vNPU can be split with template
+func IsValidVpuTemplate(template string) bool {
+	split, ok := allowSplit[template]
+	return ok && split != ""
+}
 
+func extractVpuParam(spec *specs.Spec) (string, error) {
 	for _, line := range spec.Process.Env {
 		words := strings.Split(line, "=")
 		const LENGTH int = 2
@@ -139,7 +146,11 @@ func GetProductType(w WorkerInterface) (string, error) {
 
 // GetChipName get name of chip
 func GetChipName() (string, error) {
-	dcWorker := NpuWorker{}
+	return GetChipNameByWorker(&NpuWorker{})
+}
+
+// GetChipNameByWorker get name of chip with the dcmi session of w
+func GetChipNameByWorker(dcWorker WorkerInterface) (string, error) {
 	invalidName := ""
 
 	if err := dcWorker.Initialize(); err != nil {
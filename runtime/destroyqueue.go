@@ -0,0 +1,338 @@
+/* Copyright(C) 2022. Huawei Technologies Co.,Ltd. All rights reserved.
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Package main
+package main
+
+import (
+	"encoding/json"
+	"fmt"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"sort"
+	"strings"
+	"sync"
+	"time"
+
+	"huawei.com/npu-exporter/v5/common-utils/hwlog"
+
+	"main/dcmi"
+)
+
+const (
+	// destroyQueuePath holds one empty file per vNPU to destroy, named card_device_vdevice, a vNPU queued by a
+	// daemon which did not stop cleanly is destroyed by the next one
+	destroyQueuePath   = "/run/ascend-docker-runtime/destroy-queue"
+	destroyQueueMode   = 0600
+	maxDestroyQueueLen = 4096
+	minDestroyRetry    = time.Second
+	maxDestroyRetry    = 5 * time.Minute
+	// a vNPU which still fails after maxDestroyAttempts, about ten minutes of retries, is moved to the
+	// abandoned dir of the queue and left to the operator
+	maxDestroyAttempts = 10
+	abandonedDirName   = "abandoned"
+
+	daemonStatusCmd = "daemon-status"
+	opStatus        = "status"
+)
+
+var destroyQueueDir = destroyQueuePath
+
+type queuedVDevice struct {
+	queued   time.Time
+	attempts int
+	retryAt  time.Time
+}
+
+// destroyQueue holds the vNPUs released by their containers and not destroyed yet
+type destroyQueue struct {
+	dir string
+	// mu guards the entries and the counters, it is taken after runtimeDaemon.mu
+	mu          sync.Mutex
+	entries     map[dcmi.VDeviceInfo]*queuedVDevice
+	wake        chan struct{}
+	abandoned   map[dcmi.VDeviceInfo]struct{}
+	destroyed   int
+	failures    int
+	lastLatency time.Duration
+	maxLatency  time.Duration
+}
+
+// destroyQueueStatus is what daemon-status shows of the destroy queue
+type destroyQueueStatus struct {
+	Depth         int      `json:"depth"`
+	Destroyed     int      `json:"destroyed"`
+	Failures      int      `json:"failures"`
+	Abandoned     []string `json:"abandoned"`
+	LastLatencyMs int64    `json:"lastLatencyMs"`
+	MaxLatencyMs  int64    `json:"maxLatencyMs"`
+}
+
+// daemonStatus is the answer of the status op
+type daemonStatus struct {
+	PoolReady    map[string]int     `json:"poolReady"`
+	Leases       int                `json:"leases"`
+	DestroyQueue destroyQueueStatus `json:"destroyQueue"`
+}
+
+func vdeviceFileName(vdevice dcmi.VDeviceInfo) string {
+	return fmt.Sprintf("%d_%d_%d", vdevice.CardID, vdevice.DeviceID, vdevice.VdeviceID)
+}
+
+// readVDeviceFiles returns the vNPUs named by the regular files in dir, other files are logged and skipped
+func readVDeviceFiles(dir string) (map[dcmi.VDeviceInfo]time.Time, error) {
+	files, err := ioutil.ReadDir(dir)
+	if err != nil {
+		return nil, fmt.Errorf("failed to read %s: %v", dir, err)
+	}
+	vdevices := make(map[dcmi.VDeviceInfo]time.Time, len(files))
+	for _, file := range files {
+		if file.Name() == abandonedDirName && file.IsDir() {
+			continue
+		}
+		vdevice, err := parseVDeviceArgs(strings.Split(file.Name(), "_"))
+		if err != nil || !file.Mode().IsRegular() {
+			hwlog.RunLog.Warnf("unknown file %s in %s", file.Name(), dir)
+			continue
+		}
+		vdevices[vdevice] = file.ModTime()
+	}
+	return vdevices, nil
+}
+
+// newDestroyQueue opens the queue in dir, the vNPUs already queued there are kept
+func newDestroyQueue(dir string) (*destroyQueue, error) {
+	if err := makeStateDir(dir); err != nil {
+		return nil, err
+	}
+	queued, err := readVDeviceFiles(dir)
+	if err != nil {
+		return nil, err
+	}
+	q := &destroyQueue{
+		dir:       dir,
+		entries:   make(map[dcmi.VDeviceInfo]*queuedVDevice, len(queued)),
+		abandoned: make(map[dcmi.VDeviceInfo]struct{}),
+		wake:      make(chan struct{}, 1),
+	}
+	for vdevice, mtime := range queued {
+		q.entries[vdevice] = &queuedVDevice{queued: mtime}
+	}
+	if len(q.entries) != 0 {
+		hwlog.RunLog.Infof("%d vNPUs left in the destroy queue", len(q.entries))
+	}
+	abandonedDir := filepath.Join(dir, abandonedDirName)
+	if err := checkStateDir(abandonedDir); err == nil {
+		abandoned, err := readVDeviceFiles(abandonedDir)
+		if err != nil {
+			return nil, err
+		}
+		for vdevice := range abandoned {
+			q.abandoned[vdevice] = struct{}{}
+		}
+	}
+	return q, nil
+}
+
+// push queues vdevice, it is on disk when push returns
+func (q *destroyQueue) push(vdevice dcmi.VDeviceInfo) error {
+	q.mu.Lock()
+	defer q.mu.Unlock()
+	if _, ok := q.entries[vdevice]; ok {
+		return nil
+	}
+	if len(q.entries) >= maxDestroyQueueLen {
+		return fmt.Errorf("destroy queue is full")
+	}
+	name := filepath.Join(q.dir, vdeviceFileName(vdevice))
+	if err := ioutil.WriteFile(name, nil, destroyQueueMode); err != nil {
+		return fmt.Errorf("failed to queue vNPU %v: %v", vdevice, err)
+	}
+	q.entries[vdevice] = &queuedVDevice{queued: time.Now()}
+	select {
+	case q.wake <- struct{}{}:
+	default:
+	}
+	return nil
+}
+
+// due returns the vNPUs to destroy now, per card
+func (q *destroyQueue) due(now time.Time) map[int32][]dcmi.VDeviceInfo {
+	q.mu.Lock()
+	defer q.mu.Unlock()
+	batches := make(map[int32][]dcmi.VDeviceInfo)
+	for vdevice, entry := range q.entries {
+		if !now.Before(entry.retryAt) {
+			batches[vdevice.CardID] = append(batches[vdevice.CardID], vdevice)
+		}
+	}
+	return batches
+}
+
+func (q *destroyQueue) done(vdevice dcmi.VDeviceInfo, now time.Time) {
+	q.mu.Lock()
+	defer q.mu.Unlock()
+	entry, ok := q.entries[vdevice]
+	if !ok {
+		return
+	}
+	delete(q.entries, vdevice)
+	if err := os.Remove(filepath.Join(q.dir, vdeviceFileName(vdevice))); err != nil && !os.IsNotExist(err) {
+		hwlog.RunLog.Warnf("failed to dequeue vNPU %v: %v", vdevice, err)
+	}
+	q.destroyed++
+	q.lastLatency = now.Sub(entry.queued)
+	if q.lastLatency > q.maxLatency {
+		q.maxLatency = q.lastLatency
+	}
+}
+
+// failed schedules the next try of vdevice, the delay doubles with each failure, zero is returned when vdevice
+// failed maxDestroyAttempts times and was moved to the abandoned dir
+func (q *destroyQueue) failed(vdevice dcmi.VDeviceInfo, now time.Time) time.Duration {
+	q.mu.Lock()
+	defer q.mu.Unlock()
+	q.failures++
+	entry, ok := q.entries[vdevice]
+	if !ok {
+		return 0
+	}
+	if entry.attempts+1 >= maxDestroyAttempts {
+		err := q.abandon(vdevice)
+		if err == nil {
+			return 0
+		}
+		hwlog.RunLog.Warnf("failed to abandon vNPU %v: %v", vdevice, err)
+	}
+	delay := minDestroyRetry << uint(entry.attempts)
+	if delay > maxDestroyRetry || delay <= 0 {
+		delay = maxDestroyRetry
+	}
+	entry.attempts++
+	entry.retryAt = now.Add(delay)
+	return delay
+}
+
+// abandon moves the file of vdevice to the abandoned dir, it is not tried again, q.mu is held
+func (q *destroyQueue) abandon(vdevice dcmi.VDeviceInfo) error {
+	abandonedDir := filepath.Join(q.dir, abandonedDirName)
+	if err := makeStateDir(abandonedDir); err != nil {
+		return err
+	}
+	name := vdeviceFileName(vdevice)
+	if err := os.Rename(filepath.Join(q.dir, name), filepath.Join(abandonedDir, name)); err != nil {
+		return err
+	}
+	delete(q.entries, vdevice)
+	q.abandoned[vdevice] = struct{}{}
+	return nil
+}
+
+func (q *destroyQueue) status() destroyQueueStatus {
+	q.mu.Lock()
+	defer q.mu.Unlock()
+	abandoned := make([]string, 0, len(q.abandoned))
+	for vdevice := range q.abandoned {
+		abandoned = append(abandoned, vdeviceFileName(vdevice))
+	}
+	sort.Strings(abandoned)
+	return destroyQueueStatus{
+		Depth:         len(q.entries),
+		Destroyed:     q.destroyed,
+		Failures:      q.failures,
+		Abandoned:     abandoned,
+		LastLatencyMs: q.lastLatency.Milliseconds(),
+		MaxLatencyMs:  q.maxLatency.Milliseconds(),
+	}
+}
+
+// destroyLater queues a vNPU no one uses any more, it is destroyed at once if the daemon has no queue, d.mu is
+// held
+func (d *runtimeDaemon) destroyLater(vdevice dcmi.VDeviceInfo) error {
+	if d.queue == nil {
+		return d.backend.DestroyVDevice(vdevice)
+	}
+	return d.queue.push(vdevice)
+}
+
+// drainDestroyQueue destroys the vNPUs which are due, card by card, d.mu is taken per card so that requests
+// wait for one card at most
+func (d *runtimeDaemon) drainDestroyQueue() {
+	batches := d.queue.due(d.now())
+	cards := make([]int, 0, len(batches))
+	for card := range batches {
+		cards = append(cards, int(card))
+	}
+	sort.Ints(cards)
+	for _, card := range cards {
+		d.mu.Lock()
+		for _, vdevice := range batches[int32(card)] {
+			if err := d.backend.DestroyVDevice(vdevice); err != nil {
+				if delay := d.queue.failed(vdevice, d.now()); delay != 0 {
+					hwlog.RunLog.Warnf("failed to destroy vNPU %v, retry in %v: %v", vdevice, delay, err)
+				} else {
+					hwlog.RunLog.Errorf("failed to destroy vNPU %v %d times, given up: %v", vdevice,
+						maxDestroyAttempts, err)
+				}
+				continue
+			}
+			d.queue.done(vdevice, d.now())
+		}
+		d.mu.Unlock()
+	}
+}
+
+// maintainDestroyQueue drains the destroy queue when a vNPU is queued and when a retry is due, until stop is
+// closed
+func (d *runtimeDaemon) maintainDestroyQueue(stop <-chan struct{}) {
+	ticker := time.NewTicker(minDestroyRetry)
+	defer ticker.Stop()
+	for {
+		d.drainDestroyQueue()
+		select {
+		case <-stop:
+			return
+		case <-d.queue.wake:
+		case <-ticker.C:
+		}
+	}
+}
+
+// status reports the pools, the leases and the destroy queue, d.mu is held
+func (d *runtimeDaemon) status() (string, error) {
+	status := daemonStatus{PoolReady: make(map[string]int)}
+	for key := range d.pool.targets {
+		status.PoolReady[fmt.Sprintf("%d:%s", key.device, key.template)] = len(d.pool.ready[key])
+	}
+	status.Leases = len(d.leases)
+	if d.queue != nil {
+		status.DestroyQueue = d.queue.status()
+	}
+	content, err := json.Marshal(status)
+	return string(content), err
+}
+
+// showDaemonStatus prints the status of the runtime daemon
+func showDaemonStatus(cmdArgs []string) error {
+	if len(cmdArgs) != 0 {
+		return fmt.Errorf("usage: %s", daemonStatusCmd)
+	}
+	resp, err := callDaemon(daemonRequest{Op: opStatus})
+	if err != nil {
+		return err
+	}
+	fmt.Println(resp.Value)
+	return nil
+}
@@ -0,0 +1,240 @@
+/* Copyright(C) 2022. Huawei Technologies Co.,Ltd. All rights reserved.
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Package main
+package main
+
+import (
+	"encoding/json"
+	"fmt"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"regexp"
+	"syscall"
+
+	"github.com/opencontainers/runtime-spec/specs-go"
+	"huawei.com/npu-exporter/v5/common-utils/hwlog"
+)
+
+const (
+	deviceCachePath     = "/run/ascend-docker-runtime/devices.json"
+	deviceCacheMode     = 0600
+	maxDeviceCacheSize  = 1024 * 1024
+	maxDeviceTableNodes = 4096
+	charDeviceType      = "c"
+	blockDeviceType     = "b"
+)
+
+var (
+	deviceCache = deviceCachePath
+	// ascendDeviceNameRegexp matches every node addDevice and addManagerDevice may inject
+	ascendDeviceNameRegexp = regexp.MustCompile(`^(v?davinci[0-9]+|davinci_manager(_docker)?|devmm_svm|hisi_hdc|` +
+		`svm0|ts_aisle|upgrade|sys|vdec|vpc|pngd|venc|dvpp_cmdlist|log_drv|acodec|ai|ao|vo|hdmi)$`)
+	loadedDeviceTable *deviceTable
+)
+
+type deviceNode struct {
+	Type  string `json:"type"`
+	Major int64  `json:"major"`
+	Minor int64  `json:"minor"`
+	Mode  uint32 `json:"mode"`
+	UID   uint32 `json:"uid"`
+	GID   uint32 `json:"gid"`
+}
+
+// deviceTable holds the Ascend nodes of /dev, it is valid as long as the mtime of /dev does not change,
+// which happens whenever a node is added, removed or renamed
+type deviceTable struct {
+	DevMtime int64                 `json:"devMtime"`
+	Nodes    map[string]deviceNode `json:"nodes"`
+}
+
+func getDirMtime(dir string) (int64, error) {
+	var stat syscall.Stat_t
+	if err := syscall.Stat(dir, &stat); err != nil {
+		return 0, err
+	}
+	return stat.Mtim.Nano(), nil
+}
+
+// scanDeviceNodes reads the names of dir in one pass and only stats the names accepted by match
+func scanDeviceNodes(dir string, match func(string) bool) (map[string]deviceNode, error) {
+	f, err := os.Open(dir)
+	if err != nil {
+		return nil, err
+	}
+	defer f.Close()
+	names, err := f.Readdirnames(-1)
+	if err != nil {
+		return nil, err
+	}
+	nodes := make(map[string]deviceNode)
+	for _, name := range names {
+		if !match(name) {
+			continue
+		}
+		var stat syscall.Stat_t
+		if err := syscall.Lstat(filepath.Join(dir, name), &stat); err != nil {
+			continue // removed meanwhile
+		}
+		nodeType := ""
+		switch stat.Mode & syscall.S_IFMT {
+		case syscall.S_IFCHR:
+			nodeType = charDeviceType
+		case syscall.S_IFBLK:
+			nodeType = blockDeviceType
+		default:
+			continue
+		}
+		nodes[name] = deviceNode{
+			Type:  nodeType,
+			Major: int64(unixMajor(stat.Rdev)),
+			Minor: int64(unixMinor(stat.Rdev)),
+			Mode:  stat.Mode &^ syscall.S_IFMT,
+			UID:   stat.Uid,
+			GID:   stat.Gid,
+		}
+		if len(nodes) > maxDeviceTableNodes {
+			return nil, fmt.Errorf("too many device nodes in %s", dir)
+		}
+	}
+	return nodes, nil
+}
+
+func unixMajor(dev uint64) uint32 {
+	return uint32((dev>>8)&0xfff) | uint32((dev>>32)&0xfffff000)
+}
+
+func unixMinor(dev uint64) uint32 {
+	return uint32(dev&0xff) | uint32((dev>>12)&0xffffff00)
+}
+
+func readDeviceCache(cachePath string, devMtime int64) *deviceTable {
+	if err := checkStateDir(filepath.Dir(cachePath)); err != nil {
+		return nil
+	}
+	var stat syscall.Stat_t
+	if err := syscall.Lstat(cachePath, &stat); err != nil || stat.Mode&syscall.S_IFMT != syscall.S_IFREG ||
+		stat.Uid != uint32(os.Geteuid()) || stat.Size > maxDeviceCacheSize {
+		return nil
+	}
+	content, err := ioutil.ReadFile(cachePath)
+	if err != nil {
+		return nil
+	}
+	table := &deviceTable{}
+	if err := json.Unmarshal(content, table); err != nil || table.DevMtime != devMtime || table.Nodes == nil {
+		return nil
+	}
+	return table
+}
+
+func writeDeviceCache(cachePath string, table *deviceTable) error {
+	dir := filepath.Dir(cachePath)
+	if err := makeStateDir(dir); err != nil {
+		return err
+	}
+	content, err := json.Marshal(table)
+	if err != nil {
+		return err
+	}
+	tmpFile, err := ioutil.TempFile(dir, "."+filepath.Base(cachePath))
+	if err != nil {
+		return err
+	}
+	defer os.Remove(tmpFile.Name())
+	if _, err := tmpFile.Write(content); err != nil {
+		tmpFile.Close()
+		return err
+	}
+	if err := tmpFile.Chmod(deviceCacheMode); err != nil {
+		tmpFile.Close()
+		return err
+	}
+	if err := tmpFile.Close(); err != nil {
+		return err
+	}
+	return os.Rename(tmpFile.Name(), cachePath)
+}
+
+// loadDeviceTable returns the table of the Ascend nodes in devDir, from the cache file if /dev did not change
+// since it was written, nil is returned if /dev cannot be read
+func loadDeviceTable(devDir string, cachePath string) *deviceTable {
+	devMtime, err := getDirMtime(devDir)
+	if err != nil {
+		return nil
+	}
+	if table := readDeviceCache(cachePath, devMtime); table != nil {
+		return table
+	}
+	nodes, err := scanDeviceNodes(devDir, ascendDeviceNameRegexp.MatchString)
+	if err != nil {
+		hwlog.RunLog.Warnf("failed to scan %s: %v", devDir, err)
+		return nil
+	}
+	// the mtime read before the scan is recorded, a change during the scan makes the next run scan again
+	table := &deviceTable{DevMtime: devMtime, Nodes: nodes}
+	if err := writeDeviceCache(cachePath, table); err != nil {
+		hwlog.RunLog.Warnf("failed to write device cache %s: %v", cachePath, err)
+	}
+	return table
+}
+
+func getDeviceTable() *deviceTable {
+	if loadedDeviceTable == nil {
+		loadedDeviceTable = loadDeviceTable(devicePath, deviceCache)
+	}
+	return loadedDeviceTable
+}
+
+// lookupDeviceNode returns the node of dPath from the device table, ok is false if the table cannot tell
+func lookupDeviceNode(dPath string) (*deviceNode, bool) {
+	dir, name := filepath.Split(dPath)
+	if dir != devicePath || !ascendDeviceNameRegexp.MatchString(name) {
+		return nil, false
+	}
+	table := getDeviceTable()
+	if table == nil {
+		return nil, false
+	}
+	node, ok := table.Nodes[name]
+	if !ok {
+		return nil, true
+	}
+	return &node, true
+}
+
+// deviceNodeExists tells whether dPath is a device node, without a stat if the device table knows it
+func deviceNodeExists(dPath string) bool {
+	if node, ok := lookupDeviceNode(dPath); ok {
+		return node != nil
+	}
+	_, err := os.Stat(dPath)
+	return err == nil
+}
+
+func (n *deviceNode) toLinuxDevice(dPath string) *specs.LinuxDevice {
+	fileMode := os.FileMode(n.Mode)
+	uid, gid := n.UID, n.GID
+	return &specs.LinuxDevice{
+		Path:     dPath,
+		Type:     n.Type,
+		Major:    n.Major,
+		Minor:    n.Minor,
+		FileMode: &fileMode,
+		UID:      &uid,
+		GID:      &gid,
+	}
+}
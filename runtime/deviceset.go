@@ -0,0 +1,236 @@
+/* Copyright(C) 2022. Huawei Technologies Co.,Ltd. All rights reserved.
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Package main
+package main
+
+import (
+	"fmt"
+	"math/bits"
+	"strings"
+)
+
+const (
+	// maxDeviceSetSize bounds the device ids, vNPU ids included
+	maxDeviceSetSize = 8192
+	deviceSetWords   = maxDeviceSetSize / bits.UintSize
+	// maxRangeDevice is the largest right border of a device range
+	maxRangeDevice = 128
+	maxDeviceIdLen = 9
+)
+
+// deviceSet is a fixed size bitset of device ids, iterating it yields the ids in ascending order
+type deviceSet struct {
+	words [deviceSetWords]uint
+}
+
+func (s *deviceSet) add(id int) error {
+	if id < 0 || id >= maxDeviceSetSize {
+		return fmt.Errorf("device id %d out of range", id)
+	}
+	s.words[id/bits.UintSize] |= 1 << uint(id%bits.UintSize)
+	return nil
+}
+
+// addRange adds left to right, both included, a word at a time
+func (s *deviceSet) addRange(left, right int) error {
+	if left < 0 || right >= maxDeviceSetSize || left > right {
+		return fmt.Errorf("device range %d-%d out of range", left, right)
+	}
+	for left <= right {
+		word, offset := left/bits.UintSize, uint(left%bits.UintSize)
+		width := uint(bits.UintSize) - offset
+		if remain := uint(right - left + 1); remain < width {
+			width = remain
+		}
+		mask := ^uint(0)
+		if width < bits.UintSize {
+			mask = (1<<width - 1) << offset
+		}
+		s.words[word] |= mask
+		left += int(width)
+	}
+	return nil
+}
+
+func (s *deviceSet) remove(id int) {
+	if id >= 0 && id < maxDeviceSetSize {
+		s.words[id/bits.UintSize] &^= 1 << uint(id%bits.UintSize)
+	}
+}
+
+func (s *deviceSet) contains(id int) bool {
+	return id >= 0 && id < maxDeviceSetSize && s.words[id/bits.UintSize]&(1<<uint(id%bits.UintSize)) != 0
+}
+
+func (s *deviceSet) count() int {
+	n := 0
+	for _, w := range s.words {
+		n += bits.OnesCount(w)
+	}
+	return n
+}
+
+func (s *deviceSet) union(other *deviceSet) {
+	for i := range s.words {
+		s.words[i] |= other.words[i]
+	}
+}
+
+func (s *deviceSet) intersect(other *deviceSet) {
+	for i := range s.words {
+		s.words[i] &= other.words[i]
+	}
+}
+
+func (s *deviceSet) subtract(other *deviceSet) {
+	for i := range s.words {
+		s.words[i] &^= other.words[i]
+	}
+}
+
+// next returns the smallest id not less than from, or -1 if there is none
+func (s *deviceSet) next(from int) int {
+	if from < 0 {
+		from = 0
+	}
+	if from >= maxDeviceSetSize {
+		return -1
+	}
+	word := from / bits.UintSize
+	w := s.words[word] >> uint(from%bits.UintSize)
+	if w != 0 {
+		return from + bits.TrailingZeros(w)
+	}
+	for word++; word < deviceSetWords; word++ {
+		if s.words[word] != 0 {
+			return word*bits.UintSize + bits.TrailingZeros(s.words[word])
+		}
+	}
+	return -1
+}
+
+func (s *deviceSet) toSlice() []int {
+	ids := make([]int, 0, s.count())
+	for id := s.next(0); id >= 0; id = s.next(id + 1) {
+		ids = append(ids, id)
+	}
+	return ids
+}
+
+// parseDeviceId accepts decimal digits only
+func parseDeviceId(d string) (int, bool) {
+	if d == "" || len(d) > maxDeviceIdLen {
+		return 0, false
+	}
+	n := 0
+	for i := 0; i < len(d); i++ {
+		if d[i] < '0' || d[i] > '9' {
+			return 0, false
+		}
+		n = n*10 + int(d[i]-'0')
+	}
+	return n, true
+}
+
+// forEachDeviceItem calls fn with every trimmed item of a comma separated list, without splitting the list
+func forEachDeviceItem(visibleDevices string, fn func(string) error) error {
+	for start := 0; start <= len(visibleDevices); {
+		end := strings.IndexByte(visibleDevices[start:], ',')
+		if end < 0 {
+			end = len(visibleDevices)
+		} else {
+			end += start
+		}
+		if err := fn(strings.TrimSpace(visibleDevices[start:end])); err != nil {
+			return err
+		}
+		start = end + 1
+	}
+	return nil
+}
+
+func addDeviceItem(d string, set *deviceSet) error {
+	sep := strings.IndexByte(d, '-')
+	if sep < 0 {
+		n, ok := parseDeviceId(d)
+		if !ok {
+			return fmt.Errorf("invalid single device parameter: %s", d)
+		}
+		return set.add(n)
+	}
+	if strings.IndexByte(d[sep+1:], '-') >= 0 {
+		return fmt.Errorf("invalid device range: %s", d)
+	}
+	leftBorder, rightBorder := strings.TrimSpace(d[:sep]), strings.TrimSpace(d[sep+1:])
+	left, ok := parseDeviceId(leftBorder)
+	if !ok {
+		return fmt.Errorf("invalid left boarder range parameter: %s", leftBorder)
+	}
+	right, ok := parseDeviceId(rightBorder)
+	if !ok || right > maxRangeDevice {
+		return fmt.Errorf("invalid right boarder range parameter: %s", rightBorder)
+	}
+	if left > right {
+		return fmt.Errorf("left boarder (%d) should not be larger than the right one(%d)", left, right)
+	}
+	return set.addRange(left, right)
+}
+
+// parseDeviceSet adds the ids of a list such as "0-3,5,7" to set
+func parseDeviceSet(visibleDevices string, set *deviceSet) error {
+	return forEachDeviceItem(visibleDevices, func(d string) error {
+		return addDeviceItem(d, set)
+	})
+}
+
+// parseAscendDeviceItem splits an item such as "Ascend910-3" into the chip type and the id
+func parseAscendDeviceItem(d string) (string, int, bool) {
+	if !strings.HasPrefix(d, ascend) {
+		return "", 0, false
+	}
+	rest := d[len(ascend):]
+	sep := strings.IndexByte(rest, '-')
+	if sep < 0 {
+		return "", 0, false
+	}
+	chipType := rest[:sep]
+	switch chipType {
+	case "910", "310", "310B", "310P":
+	default:
+		return "", 0, false
+	}
+	id, ok := parseDeviceId(rest[sep+1:])
+	return chipType, id, ok
+}
+
+// parseAscendDeviceSet adds the ids of a list such as "Ascend910-0,Ascend910-3" to set, and returns the chip
+// type shared by all items
+func parseAscendDeviceSet(visibleDevices string, set *deviceSet) (string, error) {
+	chipType := ""
+	err := forEachDeviceItem(visibleDevices, func(d string) error {
+		itemType, id, ok := parseAscendDeviceItem(d)
+		if !ok {
+			return fmt.Errorf("invalid device format: %s", d)
+		}
+		if chipType == "" {
+			chipType = itemType
+		}
+		if chipType != itemType {
+			return fmt.Errorf("invalid device chip type: %s", d)
+		}
+		return set.add(id)
+	})
+	return chipType, err
+}
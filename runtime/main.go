@@ -26,7 +26,6 @@ import (
 	"path"
 	"path/filepath"
 	"regexp"
-	"sort"
 	"strconv"
 	"strings"
 	"syscall"
@@ -45,6 +44,7 @@ const (
 
 	maxCommandLength = 65535
 	hookCli          = "ascend-docker-hook"
+	ascendDockerCli  = "ascend-docker-cli"
 	destroyHookCli   = "ascend-docker-destroy"
 	dockerRuncFile   = "docker-runc"
 	runcFile         = "runc"
@@ -52,19 +52,40 @@ const (
 	kvPairSize       = 2
 	borderNum        = 2
 
+	allDevices             = "all"
+	allExceptDevicesPrefix = "all-except:"
+
 	// ENV for device-plugin to identify ascend-docker-runtime
 	useAscendDocker      = "ASCEND_DOCKER_RUNTIME=True"
 	devicePlugin         = "ascend-device-plugin"
 	ascendVisibleDevices = "ASCEND_VISIBLE_DEVICES"
 	ascendRuntimeOptions = "ASCEND_RUNTIME_OPTIONS"
+
+	// node level runtime config, one "key=value" per line
+	runtimeConfigFilePath = "/etc/ascend-docker-runtime.d/runtime.conf"
+	maxRuntimeConfigLines = 128
+	prestartHookKey       = "prestart-hook"
+	prestartHookDefault   = "hook"
+	prestartHookCli       = "cli"
+	cliPrestartArg        = "--prestart"
 )
 
 var (
-	hookCliPath     = hookCli
-	hookDefaultFile = hookDefaultFilePath
-	dockerRuncName  = dockerRuncFile
-	runcName        = runcFile
-	deviceIdList    []int
+	runtimeConfigFile   = runtimeConfigFilePath
+	loadedRuntimeConfig map[string]string
+	hookCliPath         = hookCli
+	hookDefaultFile     = hookDefaultFilePath
+	dockerRuncName      = dockerRuncFile
+	runcName            = runcFile
+	deviceIdList        []int
+	// releaseThroughDaemon tells that the vNPU was created through the runtime daemon
+	releaseThroughDaemon bool
+
+	getChipName    = dcmi.GetChipName
+	getProductType = func() (string, error) { return dcmi.GetProductType(&dcmi.NpuWorker{}) }
+	createVDevice  = func(spec *specs.Spec, devices []int) (dcmi.VDeviceInfo, error) {
+		return dcmi.CreateVDevice(&dcmi.NpuWorker{}, spec, devices)
+	}
 )
 
 const (
@@ -165,6 +186,14 @@ func initLogModule(ctx context.Context) error {
 }
 
 var execRunc = func() error {
+	if err := mindxcheckutils.ChangeRuntimeLogMode("runtime-run-"); err != nil {
+		return err
+	}
+	return execRuncDirectly()
+}
+
+// execRuncDirectly execs runc without touching the log files, it returns only on failure
+func execRuncDirectly() error {
 	tempRuncPath, err := exec.LookPath(dockerRuncName)
 	if err != nil {
 		tempRuncPath, err = exec.LookPath(runcName)
@@ -180,9 +209,6 @@ var execRunc = func() error {
 		return err
 	}
 
-	if err := mindxcheckutils.ChangeRuntimeLogMode("runtime-run-"); err != nil {
-		return err
-	}
 	if err = syscall.Exec(runcPath, append([]string{runcPath}, os.Args[1:]...), os.Environ()); err != nil {
 		return fmt.Errorf("failed to exec runc: %v", err)
 	}
@@ -195,6 +221,11 @@ func addEnvToDevicePlugin(spec *specs.Spec) {
 		return
 	}
 
+	for _, line := range spec.Process.Env {
+		if line == useAscendDocker {
+			return
+		}
+	}
 	for _, line := range spec.Process.Env {
 		words := strings.Split(line, "=")
 		if len(words) == envLength && strings.TrimSpace(words[0]) == "HOSTNAME" &&
@@ -205,150 +236,212 @@ func addEnvToDevicePlugin(spec *specs.Spec) {
 	}
 }
 
+// readRuntimeConfig reads the node level runtime config, blank lines and lines starting with "#" are ignored,
+// a missing config file means all defaults
+func readRuntimeConfig() (map[string]string, error) {
+	if _, err := os.Stat(runtimeConfigFile); os.IsNotExist(err) {
+		return map[string]string{}, nil
+	}
+	realPath, err := mindxcheckutils.RealFileChecker(runtimeConfigFile, true, false, mindxcheckutils.DefaultSize)
+	if err != nil {
+		return nil, err
+	}
+	content, err := ioutil.ReadFile(realPath)
+	if err != nil {
+		return nil, fmt.Errorf("failed to read runtime config %s: %v", realPath, err)
+	}
+	return parseRuntimeConfig(string(content))
+}
+
+// getRuntimeConfig reads the runtime config once per invocation
+func getRuntimeConfig() (map[string]string, error) {
+	if loadedRuntimeConfig == nil {
+		config, err := readRuntimeConfig()
+		if err != nil {
+			return nil, fmt.Errorf("failed to read runtime config: %v", err)
+		}
+		loadedRuntimeConfig = config
+	}
+	return loadedRuntimeConfig, nil
+}
+
+func parseRuntimeConfig(content string) (map[string]string, error) {
+	config := make(map[string]string)
+	lines := strings.Split(content, "\n")
+	if len(lines) > maxRuntimeConfigLines {
+		return nil, fmt.Errorf("too many lines in runtime config")
+	}
+	for i, line := range lines {
+		line = strings.TrimSpace(line)
+		if line == "" || strings.HasPrefix(line, "#") {
+			continue
+		}
+		words := strings.SplitN(line, "=", kvPairSize)
+		if len(words) != kvPairSize {
+			return nil, fmt.Errorf("invalid line %d in runtime config", i+1)
+		}
+		config[strings.TrimSpace(words[0])] = strings.TrimSpace(words[1])
+	}
+	return config, nil
+}
+
+// getPrestartHook returns the executable registered as prestart hook and its extra args, ascend-docker-cli
+// can read the container state itself, which saves the exec of ascend-docker-hook
+func getPrestartHook(config map[string]string) (string, []string, error) {
+	switch config[prestartHookKey] {
+	case "", prestartHookDefault:
+		return hookCli, nil, nil
+	case prestartHookCli:
+		return ascendDockerCli, []string{cliPrestartArg}, nil
+	default:
+		return "", nil, fmt.Errorf("invalid %s in runtime config", prestartHookKey)
+	}
+}
+
 func addHook(spec *specs.Spec) error {
 	currentExecPath, err := os.Executable()
 	if err != nil {
 		return fmt.Errorf("cannot get the path of ascend-docker-runtime: %v", err)
 	}
 
-	hookCliPath = path.Join(path.Dir(currentExecPath), hookCli)
+	config, err := getRuntimeConfig()
+	if err != nil {
+		return err
+	}
+	hookName, hookArgs, err := getPrestartHook(config)
+	if err != nil {
+		return err
+	}
+	mountMode, err := getMountMode(config)
+	if err != nil {
+		return err
+	}
+	hookCliPath = path.Join(path.Dir(currentExecPath), hookName)
 	if _, err := mindxcheckutils.RealFileChecker(hookCliPath, true, false, mindxcheckutils.DefaultSize); err != nil {
 		return err
 	}
 	if _, err = os.Stat(hookCliPath); err != nil {
-		return fmt.Errorf("cannot find ascend-docker-hook executable file at %s: %v", hookCliPath, err)
+		return fmt.Errorf("cannot find %s executable file at %s: %v", hookName, hookCliPath, err)
 	}
 
 	if spec.Hooks == nil {
 		spec.Hooks = &specs.Hooks{}
 	}
-
-	needUpdate := true
 	if len(spec.Hooks.Prestart) > maxCommandLength {
 		return fmt.Errorf("too many items in Prestart ")
 	}
-	for _, hook := range spec.Hooks.Prestart {
-		if strings.Contains(hook.Path, hookCli) {
-			needUpdate = false
-			break
-		}
-	}
-	if needUpdate {
-		spec.Hooks.Prestart = append(spec.Hooks.Prestart, specs.Hook{
-			Path: hookCliPath,
-			Args: []string{hookCliPath},
-		})
-	}
-
 	if len(spec.Process.Env) > maxCommandLength {
 		return fmt.Errorf("too many items in Env ")
 	}
 
-	if strings.Contains(getValueByKey(spec.Process.Env, ascendRuntimeOptions), "VIRTUAL") {
-		return nil
-	}
+	isVirtual := strings.Contains(getValueByKey(spec.Process.Env, ascendRuntimeOptions), "VIRTUAL")
+	if !isVirtual {
+		vdevice, err := createVDevice(spec, deviceIdList)
+		if err != nil {
+			return err
+		}
+		hwlog.RunLog.Infof("vnpu split done: vdevice: %v", vdevice.VdeviceID)
 
-	vdevice, err := dcmi.CreateVDevice(&dcmi.NpuWorker{}, spec, deviceIdList)
-	if err != nil {
-		return err
+		if vdevice.VdeviceID != -1 {
+			updateEnvAndPostHook(spec, vdevice)
+			isVirtual = true
+		}
 	}
-	hwlog.RunLog.Infof("vnpu split done: vdevice: %v", vdevice.VdeviceID)
 
-	if vdevice.VdeviceID != -1 {
-		updateEnvAndPostHook(spec, vdevice)
+	// vNPU containers keep the prestart hook, the devices behind them are only known when the container starts
+	if mountMode == mountModeSpec && !isVirtual {
+		options, err := parseRuntimeOptions(getValueByKey(spec.Process.Env, ascendRuntimeOptions))
+		if err != nil {
+			return err
+		}
+		if canMountBySpec(options) {
+			return addSpecMounts(spec, options)
+		}
 	}
 
+	if hookName == ascendDockerCli {
+		mountArgs, err := getCliMountArgs(getValueByKey(spec.Process.Env, ascendRuntimeMounts))
+		if err != nil {
+			return err
+		}
+		hookArgs = append(hookArgs, mountArgs...)
+	}
+	addPrestartHook(spec, hookArgs)
 	return nil
 }
 
-func removeDuplication(devices []int) []int {
-	list := make([]int, 0, len(devices))
-	prev := -1
-
-	for _, device := range devices {
-		if device == prev {
-			continue
+func addPrestartHook(spec *specs.Spec, hookArgs []string) {
+	for _, hook := range spec.Hooks.Prestart {
+		if strings.Contains(hook.Path, hookCli) || strings.Contains(hook.Path, ascendDockerCli) {
+			return
 		}
-
-		list = append(list, device)
-		prev = device
 	}
-
-	return list
+	spec.Hooks.Prestart = append(spec.Hooks.Prestart, specs.Hook{
+		Path: hookCliPath,
+		Args: append([]string{hookCliPath}, hookArgs...),
+	})
 }
 
 func parseDevices(visibleDevices string) ([]int, error) {
-	devices := make([]int, 0)
-	const maxDevice = 128
-
-	for _, d := range strings.Split(visibleDevices, ",") {
-		d = strings.TrimSpace(d)
-		if strings.Contains(d, "-") {
-			borders := strings.Split(d, "-")
-			if len(borders) != borderNum {
-				return nil, fmt.Errorf("invalid device range: %s", d)
-			}
-
-			borders[0] = strings.TrimSpace(borders[0])
-			borders[1] = strings.TrimSpace(borders[1])
-
-			left, err := strconv.Atoi(borders[0])
-			if err != nil || left < 0 {
-				return nil, fmt.Errorf("invalid left boarder range parameter: %s", borders[0])
-			}
-
-			right, err := strconv.Atoi(borders[1])
-			if err != nil || right > maxDevice {
-				return nil, fmt.Errorf("invalid right boarder range parameter: %s", borders[1])
-			}
-
-			if left > right {
-				return nil, fmt.Errorf("left boarder (%d) should not be larger than the right one(%d)", left, right)
-			}
-
-			for n := left; n <= right; n++ {
-				devices = append(devices, n)
-			}
-		} else {
-			n, err := strconv.Atoi(d)
-			if err != nil {
-				return nil, fmt.Errorf("invalid single device parameter: %s", d)
-			}
-
-			devices = append(devices, n)
-		}
+	set := deviceSet{}
+	if err := parseDeviceSet(visibleDevices, &set); err != nil {
+		return nil, err
 	}
-
-	sort.Slice(devices, func(i, j int) bool { return i < j })
-	return removeDuplication(devices), nil
+	return set.toSlice(), nil
 }
 
-func parseAscendDevices(visibleDevices string) ([]int, error) {
-	devicesList := strings.Split(visibleDevices, ",")
-	devices := make([]int, 0, len(devicesList))
-	chipType := ""
-
-	for _, d := range devicesList {
-		matchGroups := regexp.MustCompile(`^Ascend(910|310|310B|310P)-(\d+)$`).FindStringSubmatch(strings.TrimSpace(d))
-		if matchGroups == nil {
-			return nil, fmt.Errorf("invalid device format: %s", d)
+// addDeviceIds adds the ids of the deviceName nodes, such as davinciN, from the device table to set, and
+// scans /dev once if the table is not available
+func addDeviceIds(deviceName string, set *deviceSet) error {
+	var nodes map[string]deviceNode
+	if table := getDeviceTable(); table != nil {
+		nodes = table.Nodes
+	} else {
+		var err error
+		if nodes, err = scanDeviceNodes(devicePath, ascendDeviceNameRegexp.MatchString); err != nil {
+			return fmt.Errorf("failed to scan %s: %v", devicePath, err)
 		}
-		n, err := strconv.Atoi(matchGroups[2])
-		if err != nil {
-			return nil, fmt.Errorf("invalid device id: %s", d)
-		}
-
-		if chipType == "" {
-			chipType = matchGroups[1]
+	}
+	for name := range nodes {
+		if !strings.HasPrefix(name, deviceName) {
+			continue
 		}
-		if chipType != "" && chipType != matchGroups[1] {
-			return nil, fmt.Errorf("invalid device chip type: %s", d)
+		if id, ok := parseDeviceId(name[len(deviceName):]); ok {
+			if err := set.add(id); err != nil {
+				return err
+			}
 		}
+	}
+	return nil
+}
 
-		devices = append(devices, n)
+// expandAllDevices turns "all" and "all-except:<list>" into the ids of the deviceName nodes of this node,
+// no dcmi call is needed
+func expandAllDevices(visibleDevices string, deviceName string) ([]int, error) {
+	excluded := deviceSet{}
+	if strings.HasPrefix(visibleDevices, allExceptDevicesPrefix) {
+		if err := parseDeviceSet(strings.TrimPrefix(visibleDevices, allExceptDevicesPrefix), &excluded); err != nil {
+			return nil, err
+		}
+	}
+	devices := deviceSet{}
+	if err := addDeviceIds(deviceName, &devices); err != nil {
+		return nil, err
+	}
+	devices.subtract(&excluded)
+	if devices.count() == 0 {
+		return nil, fmt.Errorf("no %s device left for %s", deviceName, visibleDevices)
+	}
+	return devices.toSlice(), nil
+}
 
+func parseAscendDevices(visibleDevices string) ([]int, error) {
+	set := deviceSet{}
+	chipType, err := parseAscendDeviceSet(visibleDevices, &set)
+	if err != nil {
+		return nil, err
 	}
-	chipName, err := dcmi.GetChipName()
+	chipName, err := getChipName()
 	if err != nil {
 		return nil, fmt.Errorf("get chip name error: %v", err)
 	}
@@ -356,8 +449,7 @@ func parseAscendDevices(visibleDevices string) ([]int, error) {
 		return nil, fmt.Errorf("chip type not match really: %s", chipType)
 	}
 
-	sort.Slice(devices, func(i, j int) bool { return i < j })
-	return removeDuplication(devices), nil
+	return set.toSlice(), nil
 }
 
 func getValueByKey(data []string, name string) string {
@@ -401,8 +493,15 @@ func getValueByDeviceKey(data []string) string {
 	return res
 }
 
+func getDeviceFromPath(dPath string) (*specs.LinuxDevice, error) {
+	if node, ok := lookupDeviceNode(dPath); ok && node != nil {
+		return node.toLinuxDevice(dPath), nil
+	}
+	return oci.DeviceFromPath(dPath)
+}
+
 func addDeviceToSpec(spec *specs.Spec, dPath string, deviceType string) error {
-	device, err := oci.DeviceFromPath(dPath)
+	device, err := getDeviceFromPath(dPath)
 	if err != nil {
 		return fmt.Errorf("failed to get %s info : %#v", dPath, err)
 	}
@@ -420,7 +519,7 @@ func addDeviceToSpec(spec *specs.Spec, dPath string, deviceType string) error {
 		// do nothing
 	}
 
-	spec.Linux.Devices = append(spec.Linux.Devices, *device)
+	appendLinuxDevice(spec, *device)
 	newDeviceCgroup := specs.LinuxDeviceCgroup{
 		Allow:  true,
 		Type:   device.Type,
@@ -428,7 +527,7 @@ func addDeviceToSpec(spec *specs.Spec, dPath string, deviceType string) error {
 		Minor:  &device.Minor,
 		Access: "rwm",
 	}
-	spec.Linux.Resources.Devices = append(spec.Linux.Resources.Devices, newDeviceCgroup)
+	appendDeviceCgroup(spec, newDeviceCgroup)
 	return nil
 }
 
@@ -453,17 +552,22 @@ func addAscend310BManagerDevice(spec *specs.Spec) error {
 
 	for _, device := range Ascend310BManageDevices {
 		dPath := devicePath + device
+		// not every 310B board has all of them
+		if !deviceNodeExists(dPath) {
+			hwlog.RunLog.Debugf("%s not found, skip it", dPath)
+			continue
+		}
 		if err := addDeviceToSpec(spec, dPath, notRenameDeviceType); err != nil {
 			hwlog.RunLog.Warnf("failed to add %s to spec : %#v", dPath, err)
 		}
 	}
 
 	davinciManagerPath := devicePath + davinciManagerDocker
-	if _, err := os.Stat(davinciManagerPath); err != nil {
-		hwlog.RunLog.Warnf("failed to get davinci manager docker, err: %#v", err)
+	if !deviceNodeExists(davinciManagerPath) {
+		hwlog.RunLog.Warnf("failed to get davinci manager docker %s", davinciManagerPath)
 		davinciManagerPath = devicePath + davinciManager
-		if _, err := os.Stat(davinciManagerPath); err != nil {
-			return fmt.Errorf("failed to get davinci manager, err: %#v", err)
+		if !deviceNodeExists(davinciManagerPath) {
+			return fmt.Errorf("failed to get davinci manager %s", davinciManagerPath)
 		}
 	}
 	return addDeviceToSpec(spec, davinciManagerPath, davinciManagerDocker)
@@ -486,7 +590,7 @@ func addCommonManagerDevice(spec *specs.Spec) error {
 }
 
 func addManagerDevice(spec *specs.Spec) error {
-	chipName, err := dcmi.GetChipName()
+	chipName, err := getChipName()
 	if err != nil {
 		return fmt.Errorf("get chip name error: %#v", err)
 	}
@@ -500,7 +604,7 @@ func addManagerDevice(spec *specs.Spec) error {
 		return fmt.Errorf("add davinci_manager to spec error: %#v", err)
 	}
 
-	productType, err := dcmi.GetProductType(&dcmi.NpuWorker{})
+	productType, err := getProductType()
 	if err != nil {
 		return fmt.Errorf("parse product type error: %#v", err)
 	}
@@ -524,6 +628,19 @@ func checkVisibleDevice(spec *specs.Spec) ([]int, error) {
 		return nil, nil
 	}
 
+	if visibleDevices == allDevices || strings.HasPrefix(visibleDevices, allExceptDevicesPrefix) {
+		deviceName := davinciName
+		if strings.Contains(getValueByKey(spec.Process.Env, ascendRuntimeOptions), "VIRTUAL") {
+			deviceName = virtualDavinciName
+		}
+		devices, err := expandAllDevices(visibleDevices, deviceName)
+		if err != nil {
+			return nil, fmt.Errorf("failed to expand devices : %v", err)
+		}
+		hwlog.RunLog.Infof("devices is: %v", devices)
+		return devices, nil
+	}
+
 	if strings.Contains(visibleDevices, ascend) {
 		devices, err := parseAscendDevices(visibleDevices)
 		if err != nil {
@@ -541,6 +658,7 @@ func checkVisibleDevice(spec *specs.Spec) ([]int, error) {
 }
 
 func addDevice(spec *specs.Spec) error {
+	firstRule := len(spec.Linux.Resources.Devices)
 	deviceName := davinciName
 	if strings.Contains(getValueByKey(spec.Process.Env, ascendRuntimeOptions), "VIRTUAL") {
 		deviceName = virtualDavinciName
@@ -556,6 +674,14 @@ func addDevice(spec *specs.Spec) error {
 		return fmt.Errorf("failed to add Manager device to spec: %v", err)
 	}
 
+	config, err := getRuntimeConfig()
+	if err != nil {
+		return err
+	}
+	if config[cgroupWildcardKey] == "true" {
+		coalesceAddedDeviceCgroups(spec, firstRule)
+	}
+
 	return nil
 }
 
@@ -582,15 +708,43 @@ func updateEnvAndPostHook(spec *specs.Spec, vdevice dcmi.VDeviceInfo) {
 	}
 	spec.Process.Env = newEnv
 	if currentExecPath, err := os.Executable(); err == nil {
+		vdeviceArgs := []string{fmt.Sprintf("%d", vdevice.CardID), fmt.Sprintf("%d", vdevice.DeviceID),
+			fmt.Sprintf("%d", vdevice.VdeviceID)}
 		postHookCliPath := path.Join(path.Dir(currentExecPath), destroyHookCli)
-		spec.Hooks.Poststop = append(spec.Hooks.Poststop, specs.Hook{
+		postHookArgs := append([]string{postHookCliPath}, vdeviceArgs...)
+		if releaseThroughDaemon {
+			postHookCliPath = currentExecPath
+			postHookArgs = append([]string{postHookCliPath, releaseVDeviceCmd}, vdeviceArgs...)
+		}
+		spec.Hooks.Poststop = appendHook(spec.Hooks.Poststop, specs.Hook{
 			Path: postHookCliPath,
-			Args: []string{postHookCliPath, fmt.Sprintf("%d", vdevice.CardID), fmt.Sprintf("%d", vdevice.DeviceID),
-				fmt.Sprintf("%d", vdevice.VdeviceID)},
+			Args: postHookArgs,
 		})
 	}
 }
 
+// applyAscendSpec adds the devices, hooks and mounts of the visible Ascend devices to spec
+func applyAscendSpec(spec *specs.Spec) error {
+	devices, err := checkVisibleDevice(spec)
+	if err != nil {
+		hwlog.RunLog.Errorf("failed to check ASCEND_VISIBLE_DEVICES parameter, err: %v", err)
+		return fmt.Errorf("failed to check ASCEND_VISIBLE_DEVICES parameter, err: %v", err)
+	}
+	if len(devices) != 0 {
+		deviceIdList = devices
+		if err := addHook(spec); err != nil {
+			hwlog.RunLog.Errorf("failed to inject hook, err: %v", err)
+			return fmt.Errorf("failed to inject hook, err: %v", err)
+		}
+		if err := addDevice(spec); err != nil {
+			return fmt.Errorf("failed to add device to env: %v", err)
+		}
+	}
+
+	addEnvToDevicePlugin(spec)
+	return nil
+}
+
 func modifySpecFile(path string) error {
 	stat, err := os.Stat(path)
 	if err != nil {
@@ -612,41 +766,37 @@ func modifySpecFile(path string) error {
 		return fmt.Errorf("failed to read oci spec file %s: %v", path, err)
 	}
 
-	if err = jsonFile.Truncate(0); err != nil {
-		return fmt.Errorf("failed to truncate: %v", err)
-	}
-	if _, err = jsonFile.Seek(0, 0); err != nil {
-		return fmt.Errorf("failed to seek: %v", err)
-	}
-
 	var spec specs.Spec
 	if err = json.Unmarshal(jsonContent, &spec); err != nil {
 		return fmt.Errorf("failed to unmarshal oci spec file %s: %v", path, err)
 	}
 
-	devices, err := checkVisibleDevice(&spec)
+	config, err := getRuntimeConfig()
 	if err != nil {
-		hwlog.RunLog.Errorf("failed to check ASCEND_VISIBLE_DEVICES parameter, err: %v", err)
-		return fmt.Errorf("failed to check ASCEND_VISIBLE_DEVICES parameter, err: %v", err)
+		return err
 	}
-	if len(devices) != 0 {
-		deviceIdList = devices
-		if err = addHook(&spec); err != nil {
-			hwlog.RunLog.Errorf("failed to inject hook, err: %v", err)
-			return fmt.Errorf("failed to inject hook, err: %v", err)
-		}
-		if err = addDevice(&spec); err != nil {
-			return fmt.Errorf("failed to add device to env: %v", err)
-		}
+	// a retried create on the same bundle finds the spec as it was written, neither dcmi nor the file is touched
+	if isSpecPatched(&spec, config) {
+		hwlog.RunLog.Infof("oci spec file %s is already patched", path)
+		return nil
 	}
 
-	addEnvToDevicePlugin(&spec)
+	if err = applyAscendSpec(&spec); err != nil {
+		return err
+	}
+	if err = markSpecPatched(&spec, config); err != nil {
+		return fmt.Errorf("failed to hash OCI spec file: %v", err)
+	}
 
 	jsonOutput, err := json.Marshal(spec)
 	if err != nil {
 		return fmt.Errorf("failed to marshal OCI spec file: %v", err)
 	}
 
+	if err = jsonFile.Truncate(0); err != nil {
+		return fmt.Errorf("failed to truncate: %v", err)
+	}
+
 	if _, err = jsonFile.WriteAt(jsonOutput, 0); err != nil {
 		return fmt.Errorf("failed to write OCI spec file: %v", err)
 	}
@@ -655,6 +805,19 @@ func modifySpecFile(path string) error {
 }
 
 func doProcess() error {
+	if len(os.Args) > 1 && os.Args[1] == generateCdiCmd {
+		return generateCdi(os.Args[2:])
+	}
+	if len(os.Args) > 1 && os.Args[1] == daemonCmd {
+		return runDaemon(os.Args[2:])
+	}
+	if len(os.Args) > 1 && os.Args[1] == releaseVDeviceCmd {
+		return runReleaseVDevice(os.Args[2:])
+	}
+	if len(os.Args) > 1 && os.Args[1] == daemonStatusCmd {
+		return showDaemonStatus(os.Args[2:])
+	}
+
 	args, err := getArgs()
 	if err != nil {
 		return fmt.Errorf("failed to get args: %v", err)
@@ -672,6 +835,7 @@ func doProcess() error {
 	}
 
 	specFilePath := args.bundleDirPath + "/config.json"
+	useDaemonIfRunning()
 
 	if err = modifySpecFile(specFilePath); err != nil {
 		return fmt.Errorf("failed to modify spec file %s: %v", specFilePath, err)
@@ -680,12 +844,37 @@ func doProcess() error {
 	return execRunc()
 }
 
+// isRuncPassthrough reports whether runc handles the command alone, same as the check of doProcess
+func isRuncPassthrough(cmdArgs []string) bool {
+	if len(cmdArgs) > 1 && (cmdArgs[1] == generateCdiCmd || cmdArgs[1] == daemonCmd ||
+		cmdArgs[1] == releaseVDeviceCmd || cmdArgs[1] == daemonStatusCmd) {
+		return false
+	}
+	for _, arg := range cmdArgs {
+		if arg == "create" {
+			return false
+		}
+	}
+	return true
+}
+
+func checkCmdArgs() bool {
+	return mindxcheckutils.StringChecker(strings.Join(os.Args, " "), 0,
+		maxCommandLength, mindxcheckutils.DefaultWhiteList+" ")
+}
+
 func main() {
 	defer func() {
 		if err := recover(); err != nil {
 			log.Fatal(err)
 		}
 	}()
+	// most commands of a container lifecycle only pass through to runc, they are handed over before the
+	// logger is set up, if the exec fails the normal path below runs and reports the failure. The runtime is
+	// still exec'd once per runc command, keeping it alive across a pod needs a containerd shim
+	if isRuncPassthrough(os.Args) && checkCmdArgs() {
+		_ = execRuncDirectly()
+	}
 	ctx, _ := context.WithCancel(context.Background())
 	if err := initLogModule(ctx); err != nil {
 		log.Fatal(err)
@@ -699,8 +888,7 @@ func main() {
 			fmt.Println("defer changeFileMode function failed")
 		}
 	}()
-	if !mindxcheckutils.StringChecker(strings.Join(os.Args, " "), 0,
-		maxCommandLength, mindxcheckutils.DefaultWhiteList+" ") {
+	if !checkCmdArgs() {
 		hwlog.RunLog.Errorf("%v ascend docker runtime args check failed", logPrefixWords)
 		log.Fatal("command error")
 	}
@@ -17,10 +17,16 @@ package main
 
 import (
 	"context"
+	"encoding/json"
 	"fmt"
+	"io/ioutil"
 	"os"
 	"reflect"
+	"strconv"
+	"strings"
+	"sync"
 	"testing"
+	"time"
 
 	"github.com/agiledragon/gomonkey/v2"
 	"github.com/containerd/containerd/oci"
@@ -257,14 +263,6 @@ func TestParseDevicesCase7(t *testing.T) {
 	assert.NotNil(t, err)
 }
 
-func TestRemoveDuplication(t *testing.T) {
-	originList := []int{1, 2, 2, 4, 5, 5, 5, 6, 8, 8}
-	targetList := []int{1, 2, 4, 5, 6, 8}
-	resultList := removeDuplication(originList)
-
-	assert.EqualValues(t, targetList, resultList)
-}
-
 func TestAddEnvToDevicePlugin0(t *testing.T) {
 	devicePluginHostName := devicePlugin + "pf2i6r"
 	spec := specs.Spec{
@@ -515,3 +513,789 @@ func TestAddDevice(t *testing.T) {
 	assert.Nil(t, err)
 	assert.Contains(t, spec.Linux.Devices[0].Path, devPath)
 }
+
+func TestReadRuntimeConfigWithoutFile(t *testing.T) {
+	defer func(file string) { runtimeConfigFile = file }(runtimeConfigFile)
+	runtimeConfigFile = "/ascend-docker-ut-not-exist/runtime.conf"
+	config, err := readRuntimeConfig()
+	assert.Nil(t, err)
+	assert.Equal(t, 0, len(config))
+}
+
+func TestParseRuntimeConfig(t *testing.T) {
+	config, err := parseRuntimeConfig("# comment\n\n prestart-hook = cli \nkey=a=b\n")
+	assert.Nil(t, err)
+	assert.Equal(t, map[string]string{"prestart-hook": "cli", "key": "a=b"}, config)
+
+	_, err = parseRuntimeConfig("prestart-hook\n")
+	assert.NotNil(t, err)
+}
+
+func TestGetPrestartHook(t *testing.T) {
+	hookName, hookArgs, err := getPrestartHook(map[string]string{})
+	assert.Nil(t, err)
+	assert.Equal(t, hookCli, hookName)
+	assert.Equal(t, 0, len(hookArgs))
+
+	hookName, hookArgs, err = getPrestartHook(map[string]string{prestartHookKey: prestartHookCli})
+	assert.Nil(t, err)
+	assert.Equal(t, ascendDockerCli, hookName)
+	assert.Equal(t, []string{cliPrestartArg}, hookArgs)
+
+	_, _, err = getPrestartHook(map[string]string{prestartHookKey: "shim"})
+	assert.NotNil(t, err)
+}
+
+func TestGetMountMode(t *testing.T) {
+	mode, err := getMountMode(map[string]string{})
+	assert.Nil(t, err)
+	assert.Equal(t, mountModeHook, mode)
+
+	mode, err = getMountMode(map[string]string{mountModeKey: mountModeSpec})
+	assert.Nil(t, err)
+	assert.Equal(t, mountModeSpec, mode)
+
+	_, err = getMountMode(map[string]string{mountModeKey: "runc"})
+	assert.NotNil(t, err)
+}
+
+func TestCanMountBySpec(t *testing.T) {
+	options, err := parseRuntimeOptions("NODRV, VIRTUAL")
+	assert.Nil(t, err)
+	assert.True(t, canMountBySpec(options))
+
+	options, err = parseRuntimeOptions("COPYIN")
+	assert.Nil(t, err)
+	assert.False(t, canMountBySpec(options))
+
+	_, err = parseRuntimeOptions("NODRV,UNKNOWN")
+	assert.NotNil(t, err)
+}
+
+func TestMountWhiteListFromCli(t *testing.T) {
+	_, ok := mountWhiteList["/usr/local/dcmi"]
+	assert.True(t, ok)
+	_, ok = mountWhiteList[""]
+	assert.False(t, ok)
+}
+
+func TestGetCliMountArgs(t *testing.T) {
+	backup := mountConfigDir
+	mountConfigDir = "/ascend-docker-ut-not-exist"
+	defer func() { mountConfigDir = backup }()
+	_, err := getCliMountArgs("")
+	assert.NotNil(t, err)
+}
+
+func TestBuildSpecMounts(t *testing.T) {
+	existing := []specs.Mount{{Destination: "/etc/hdcBasic.cfg/", Source: "/tmp/hdcBasic.cfg"}}
+	mounts := buildSpecMounts(existing, []string{"/etc/hdcBasic.cfg", "/usr/local/dcmi"})
+	assert.Equal(t, 1, len(mounts))
+	assert.Equal(t, "/usr/local/dcmi", mounts[0].Source)
+	assert.Equal(t, "/usr/local/dcmi", mounts[0].Destination)
+	assert.Equal(t, []string{"bind", "ro", "nosuid"}, mounts[0].Options)
+}
+
+func TestCheckMountSource(t *testing.T) {
+	_, err := checkMountSource("/etc/passwd", false)
+	assert.NotNil(t, err)
+
+	if _, err := os.Stat("/home/data/miniD/driver/lib64"); os.IsNotExist(err) {
+		exists, err := checkMountSource("/home/data/miniD/driver/lib64", false)
+		assert.Nil(t, err)
+		assert.False(t, exists)
+	}
+}
+
+func TestGetCdiOutput(t *testing.T) {
+	output, err := getCdiOutput([]string{})
+	assert.Nil(t, err)
+	assert.Equal(t, cdiDefaultOutputPath, output)
+
+	output, err = getCdiOutput([]string{cdiOutputArg, "/var/run/cdi/ascend.json"})
+	assert.Nil(t, err)
+	assert.Equal(t, "/var/run/cdi/ascend.json", output)
+
+	_, err = getCdiOutput([]string{cdiOutputArg})
+	assert.NotNil(t, err)
+	_, err = getCdiOutput([]string{cdiOutputArg, "ascend.json"})
+	assert.NotNil(t, err)
+}
+
+func TestGetCdiFingerprint(t *testing.T) {
+	dir := t.TempDir()
+	versionFile := dir + "/version.info"
+	assert.Nil(t, ioutil.WriteFile(versionFile, []byte("Version=1.0\n"), 0600))
+	fingerprint := getCdiFingerprint(dir, []int{}, []string{versionFile})
+	assert.Equal(t, fingerprint, getCdiFingerprint(dir, []int{}, []string{versionFile}))
+
+	assert.Nil(t, ioutil.WriteFile(versionFile, []byte("Version=2.0\n"), 0600))
+	assert.True(t, fingerprint != getCdiFingerprint(dir, []int{}, []string{versionFile}))
+}
+
+func TestToCdiEdits(t *testing.T) {
+	nodes := toCdiDeviceNodes([]specs.LinuxDevice{{Path: "/dev/davinci0", Type: "c", Major: 236, Minor: 0}})
+	assert.Equal(t, 1, len(nodes))
+	assert.Equal(t, "/dev/davinci0", nodes[0].Path)
+	assert.Equal(t, int64(236), nodes[0].Major)
+	assert.Equal(t, "rwm", nodes[0].Permissions)
+
+	mounts := toCdiMounts(buildSpecMounts(nil, []string{"/usr/local/dcmi"}))
+	assert.Equal(t, []cdiMount{{HostPath: "/usr/local/dcmi", ContainerPath: "/usr/local/dcmi", Type: "bind",
+		Options: []string{"bind", "ro", "nosuid"}}}, mounts)
+}
+
+// fakeNriStub plays the part of the NRI stub, it passes the container of a CreateContainer request to the
+// plugin and applies the returned adjustment to the container spec
+type fakeNriStub struct {
+	plugin *nriPlugin
+}
+
+func (s *fakeNriStub) createContainer(spec *specs.Spec) error {
+	adjust, err := s.plugin.CreateContainer(spec.Process.Env, spec.Mounts)
+	if err != nil {
+		return err
+	}
+	spec.Process.Env = append(spec.Process.Env, adjust.Env...)
+	spec.Mounts = append(spec.Mounts, adjust.Mounts...)
+	spec.Linux.Devices = append(spec.Linux.Devices, adjust.Devices...)
+	spec.Linux.Resources.Devices = append(spec.Linux.Resources.Devices, adjust.DeviceCgroups...)
+	spec.Hooks.Prestart = append(spec.Hooks.Prestart, adjust.Prestart...)
+	spec.Hooks.Poststop = append(spec.Hooks.Poststop, adjust.Poststop...)
+	return nil
+}
+
+func TestNriPluginCreateContainer(t *testing.T) {
+	defer func(chipName, productType func() (string, error)) {
+		getChipName, getProductType = chipName, productType
+		warmDcmiQueries = sync.Once{}
+	}(getChipName, getProductType)
+	warmDcmiQueries = sync.Once{}
+	stub := &fakeNriStub{plugin: newNriPlugin()}
+	spec := &specs.Spec{
+		Process: &specs.Process{Env: []string{"HOSTNAME=ascend-device-plugin-xxx"}},
+		Mounts:  []specs.Mount{{Destination: "/data", Source: "/data", Type: "bind"}},
+		Hooks:   &specs.Hooks{},
+		Linux:   &specs.Linux{Resources: &specs.LinuxResources{}},
+	}
+	assert.Nil(t, stub.createContainer(spec))
+	assert.Equal(t, []string{"HOSTNAME=ascend-device-plugin-xxx", useAscendDocker}, spec.Process.Env)
+	assert.Equal(t, 1, len(spec.Mounts))
+	assert.Equal(t, 0, len(spec.Linux.Devices))
+	assert.Equal(t, 0, len(spec.Hooks.Prestart))
+
+	spec.Process.Env = []string{"ASCEND_VISIBLE_DEVICES=0-"}
+	assert.NotNil(t, stub.createContainer(spec))
+}
+
+func TestNewNriPluginCachesDcmi(t *testing.T) {
+	defer func(chipName, productType func() (string, error)) {
+		getChipName, getProductType = chipName, productType
+		warmDcmiQueries = sync.Once{}
+	}(getChipName, getProductType)
+	warmDcmiQueries = sync.Once{}
+	calls := 0
+	getChipName = func() (string, error) {
+		calls++
+		return "310P3", nil
+	}
+	newNriPlugin()
+	newNriPlugin()
+	for i := 0; i < 3; i++ {
+		name, err := getChipName()
+		assert.Nil(t, err)
+		assert.Equal(t, "310P3", name)
+	}
+	assert.Equal(t, 1, calls)
+}
+
+func TestGetAdjustment(t *testing.T) {
+	env := []string{"ASCEND_VISIBLE_DEVICES=0", "ASCEND_RUNTIME_OPTIONS=NODRV"}
+	spec := &specs.Spec{
+		Process: &specs.Process{Env: []string{"ASCEND_VISIBLE_DEVICES=0", "ASCEND_RUNTIME_OPTIONS=NODRV,VIRTUAL"}},
+		Mounts:  []specs.Mount{{Destination: "/data"}, {Destination: "/usr/local/dcmi"}},
+		Hooks:   &specs.Hooks{Prestart: []specs.Hook{{Path: "/usr/local/bin/ascend-docker-hook"}}},
+		Linux: &specs.Linux{Devices: []specs.LinuxDevice{{Path: "/dev/davinci0"}},
+			Resources: &specs.LinuxResources{Devices: []specs.LinuxDeviceCgroup{{Allow: true}}}},
+	}
+	adjust := getAdjustment(env, 1, spec)
+	assert.Equal(t, []string{"ASCEND_RUNTIME_OPTIONS=NODRV,VIRTUAL"}, adjust.Env)
+	assert.Equal(t, []specs.Mount{{Destination: "/usr/local/dcmi"}}, adjust.Mounts)
+	assert.Equal(t, 1, len(adjust.Devices))
+	assert.Equal(t, 1, len(adjust.DeviceCgroups))
+	assert.Equal(t, 1, len(adjust.Prestart))
+}
+
+func TestCachedDcmiQuery(t *testing.T) {
+	calls := 0
+	query := cachedDcmiQuery(func() (string, error) {
+		calls++
+		if calls == 1 {
+			return "", fmt.Errorf("dcmi not ready")
+		}
+		return "310P3", nil
+	})
+	_, err := query()
+	assert.NotNil(t, err)
+	for i := 0; i < 3; i++ {
+		name, err := query()
+		assert.Nil(t, err)
+		assert.Equal(t, "310P3", name)
+	}
+	assert.Equal(t, 2, calls)
+}
+
+func TestIsRuncPassthrough(t *testing.T) {
+	assert.True(t, isRuncPassthrough([]string{"ascend-docker-runtime", "--root", "/run/runc", "start", "id"}))
+	assert.True(t, isRuncPassthrough([]string{"ascend-docker-runtime"}))
+	assert.False(t, isRuncPassthrough([]string{"ascend-docker-runtime", "create", "--bundle", ".", "id"}))
+	assert.False(t, isRuncPassthrough([]string{"ascend-docker-runtime", generateCdiCmd}))
+}
+
+type fakeDcmiBackend struct {
+	chipNameCalls int
+	created       int
+	destroyed     []dcmi.VDeviceInfo
+	destroyErr    error
+}
+
+func (b *fakeDcmiBackend) ChipName() (string, error) {
+	b.chipNameCalls++
+	return "310P3", nil
+}
+
+func (b *fakeDcmiBackend) ProductType() (string, error) {
+	return "Atlas 300I Pro", nil
+}
+
+func (b *fakeDcmiBackend) CreateVDevice(spec *specs.Spec, devices []int) (dcmi.VDeviceInfo, error) {
+	if getValueByKey(spec.Process.Env, "ASCEND_VNPU_SPECS") == "" {
+		return dcmi.VDeviceInfo{CardID: -1, DeviceID: -1, VdeviceID: -1}, nil
+	}
+	b.created++
+	return dcmi.VDeviceInfo{CardID: 1, DeviceID: 0, VdeviceID: int32(100 + devices[0] + 10*(b.created-1))}, nil
+}
+
+func (b *fakeDcmiBackend) DestroyVDevice(vdevice dcmi.VDeviceInfo) error {
+	if b.destroyErr != nil {
+		return b.destroyErr
+	}
+	b.destroyed = append(b.destroyed, vdevice)
+	return nil
+}
+
+func TestRuntimeDaemon(t *testing.T) {
+	defer func(socket string, chipName, productType func() (string, error),
+		create func(*specs.Spec, []int) (dcmi.VDeviceInfo, error)) {
+		daemonSocket, getChipName, getProductType, createVDevice = socket, chipName, productType, create
+	}(daemonSocket, getChipName, getProductType, createVDevice)
+	daemonSocket = t.TempDir() + "/runtimed.sock"
+	listener, err := listenDaemonSocket(daemonSocket)
+	assert.Nil(t, err)
+	defer listener.Close()
+	backend := &fakeDcmiBackend{}
+	daemon := newRuntimeDaemon(backend, nil, 0)
+	go daemon.serve(listener)
+
+	getChipName = func() (string, error) { return "", fmt.Errorf("direct path should not be taken") }
+	useDaemonIfRunning()
+	for i := 0; i < 2; i++ {
+		chipName, err := getChipName()
+		assert.Nil(t, err)
+		assert.Equal(t, "310P3", chipName)
+	}
+	assert.Equal(t, 1, backend.chipNameCalls)
+
+	spec := &specs.Spec{Process: &specs.Process{Env: []string{"ASCEND_VNPU_SPECS=vir04"}}}
+	vdevice, err := createVDevice(spec, []int{2})
+	assert.Nil(t, err)
+	assert.Equal(t, int32(102), vdevice.VdeviceID)
+	assert.Equal(t, 1, len(daemon.ledger))
+
+	_, err = callDaemon(daemonRequest{Op: opDestroyVDevice, VDevice: &vdevice})
+	assert.Nil(t, err)
+	assert.Equal(t, []dcmi.VDeviceInfo{vdevice}, backend.destroyed)
+	assert.Equal(t, 0, len(daemon.ledger))
+
+	_, err = callDaemon(daemonRequest{Op: "unknown"})
+	assert.NotNil(t, err)
+}
+
+func TestRuntimeDaemonAbsent(t *testing.T) {
+	defer func(socket string, chipName func() (string, error)) {
+		daemonSocket, getChipName = socket, chipName
+	}(daemonSocket, getChipName)
+	daemonSocket = t.TempDir() + "/runtimed.sock"
+	getChipName = func() (string, error) { return "910B", nil }
+	useDaemonIfRunning()
+	chipName, err := getChipName()
+	assert.Nil(t, err)
+	assert.Equal(t, "910B", chipName)
+}
+
+func TestScanDeviceNodes(t *testing.T) {
+	nodes, err := scanDeviceNodes("/dev", func(name string) bool { return name == "null" || name == "shm" })
+	assert.Nil(t, err)
+	assert.Equal(t, 1, len(nodes))
+	assert.Equal(t, deviceNode{Type: "c", Major: 1, Minor: 3, Mode: nodes["null"].Mode}, nodes["null"])
+	assert.True(t, ascendDeviceNameRegexp.MatchString("davinci12"))
+	assert.True(t, ascendDeviceNameRegexp.MatchString("davinci_manager_docker"))
+	assert.False(t, ascendDeviceNameRegexp.MatchString("davinci"))
+}
+
+func TestDeviceCache(t *testing.T) {
+	devDir, cacheDir := t.TempDir(), t.TempDir()
+	cachePath := cacheDir + "/devices.json"
+	// an old mtime makes sure the mtime changes when a node is added below
+	oldTime := time.Now().Add(-time.Hour)
+	assert.Nil(t, os.Chtimes(devDir, oldTime, oldTime))
+	table := loadDeviceTable(devDir, cachePath)
+	assert.NotNil(t, table)
+	assert.Equal(t, 0, len(table.Nodes))
+
+	// the cached table is used as long as the dir does not change
+	table.Nodes["davinci0"] = deviceNode{Type: "c", Major: 236}
+	assert.Nil(t, writeDeviceCache(cachePath, table))
+	table = loadDeviceTable(devDir, cachePath)
+	assert.Equal(t, int64(236), table.Nodes["davinci0"].Major)
+
+	assert.Nil(t, ioutil.WriteFile(devDir+"/davinci1", []byte{}, 0600))
+	mtime, err := getDirMtime(devDir)
+	assert.Nil(t, err)
+	assert.Nil(t, readDeviceCache(cachePath, mtime))
+	table = loadDeviceTable(devDir, cachePath)
+	assert.Equal(t, 0, len(table.Nodes))
+}
+
+func TestExpandAllDevices(t *testing.T) {
+	defer func(table *deviceTable) { loadedDeviceTable = table }(loadedDeviceTable)
+	loadedDeviceTable = &deviceTable{Nodes: map[string]deviceNode{
+		"davinci3": {}, "davinci0": {}, "davinci10": {}, "davinci_manager": {}, "vdavinci100": {},
+	}}
+
+	devices, err := expandAllDevices(allDevices, davinciName)
+	assert.Nil(t, err)
+	assert.Equal(t, []int{0, 3, 10}, devices)
+
+	devices, err = expandAllDevices("all-except:0,5-10", davinciName)
+	assert.Nil(t, err)
+	assert.Equal(t, []int{3}, devices)
+
+	devices, err = expandAllDevices(allDevices, virtualDavinciName)
+	assert.Nil(t, err)
+	assert.Equal(t, []int{100}, devices)
+
+	_, err = expandAllDevices("all-except:0-10", davinciName)
+	assert.NotNil(t, err)
+	_, err = expandAllDevices("all-except:x", davinciName)
+	assert.NotNil(t, err)
+
+	spec := &specs.Spec{Process: &specs.Process{Env: []string{"ASCEND_VISIBLE_DEVICES=all-except:3"}}}
+	devices, err = checkVisibleDevice(spec)
+	assert.Nil(t, err)
+	assert.Equal(t, []int{0, 10}, devices)
+}
+
+// deviceListSeeds seed FuzzParseDevices and drive the parse benchmarks
+var deviceListSeeds = []string{"0", "0-127", "0-3,5,7", " 1 , 3 - 6 ,2", "127,0,64-70,3,3,3", "100,101,1023",
+	"0-3-4", "4-3", "0-129", "x", "", "1,", "+5", "99999999999"}
+
+func TestDeviceSet(t *testing.T) {
+	set := deviceSet{}
+	assert.Nil(t, set.addRange(60, 130))
+	assert.Nil(t, set.add(5))
+	assert.NotNil(t, set.add(maxDeviceSetSize))
+	assert.NotNil(t, set.addRange(3, 2))
+	assert.Equal(t, 72, set.count())
+	assert.True(t, set.contains(63) && set.contains(64) && set.contains(130))
+	assert.False(t, set.contains(59) || set.contains(131) || set.contains(-1))
+	assert.Equal(t, 60, set.next(6))
+	assert.Equal(t, -1, set.next(131))
+
+	other := deviceSet{}
+	assert.Nil(t, other.addRange(0, 63))
+	set.subtract(&other)
+	assert.Equal(t, 64, set.next(0))
+	set.union(&other)
+	set.intersect(&other)
+	set.remove(0)
+	assert.Equal(t, 63, set.count())
+	assert.Equal(t, 1, set.toSlice()[0])
+}
+
+func TestParseDevicesSyntax(t *testing.T) {
+	devices, err := parseDevices(" 7 , 3 - 5 ,4,100")
+	assert.Nil(t, err)
+	assert.Equal(t, []int{3, 4, 5, 7, 100}, devices)
+	for _, visibleDevices := range []string{"", "1,", "0-129", "+5", "1--2", "-1"} {
+		_, err = parseDevices(visibleDevices)
+		assert.NotNil(t, err, visibleDevices)
+	}
+
+	set := deviceSet{}
+	chipType, err := parseAscendDeviceSet("Ascend310P-3, Ascend310P-1,Ascend310P-3", &set)
+	assert.Nil(t, err)
+	assert.Equal(t, "310P", chipType)
+	assert.Equal(t, []int{1, 3}, set.toSlice())
+	_, err = parseAscendDeviceSet("Ascend310P-3,Ascend310-1", &set)
+	assert.NotNil(t, err)
+	_, err = parseAscendDeviceSet("Ascend910B-3", &set)
+	assert.NotNil(t, err)
+}
+
+func FuzzParseDevices(f *testing.F) {
+	for _, seed := range deviceListSeeds {
+		f.Add(seed)
+	}
+	f.Fuzz(func(t *testing.T, visibleDevices string) {
+		devices, err := parseDevices(visibleDevices)
+		if err != nil {
+			return
+		}
+		for i := 1; i < len(devices); i++ {
+			if devices[i-1] >= devices[i] {
+				t.Fatalf("%q parsed to unordered %v", visibleDevices, devices)
+			}
+		}
+		// the parsed ids parse back to themselves
+		items := make([]string, 0, len(devices))
+		for _, id := range devices {
+			items = append(items, strconv.Itoa(id))
+		}
+		again, err := parseDevices(strings.Join(items, ","))
+		if err != nil || !reflect.DeepEqual(devices, again) {
+			t.Fatalf("%q parsed to %v, which parses to %v, %v", visibleDevices, devices, again, err)
+		}
+	})
+}
+
+func BenchmarkParseDeviceSetRange(b *testing.B) {
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		set := deviceSet{}
+		if err := parseDeviceSet("0-127", &set); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkParseDevices(b *testing.B) {
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		for _, seed := range deviceListSeeds {
+			_, _ = parseDevices(seed)
+		}
+	}
+}
+
+// isDeviceAllowed evaluates device cgroup rules the way the kernel does, the last matching rule wins
+func isDeviceAllowed(rules []specs.LinuxDeviceCgroup, devType string, major, minor int64) bool {
+	allowed := false
+	for _, rule := range rules {
+		if (rule.Type == "" || rule.Type == "a" || rule.Type == devType) &&
+			(rule.Major == nil || *rule.Major == major) && (rule.Minor == nil || *rule.Minor == minor) {
+			allowed = rule.Allow
+		}
+	}
+	return allowed
+}
+
+func TestCoalesceDeviceCgroups(t *testing.T) {
+	nodeRule := func(major, minor int64) specs.LinuxDeviceCgroup {
+		return specs.LinuxDeviceCgroup{Allow: true, Type: "c", Major: &major, Minor: &minor, Access: "rwm"}
+	}
+	sysDir := t.TempDir()
+	for _, name := range []string{"236:0", "236:1", "236:2", "237:0", "237:1", "238:0", "1:3"} {
+		assert.Nil(t, os.Symlink("../../devices/x", sysDir+"/"+name))
+	}
+	registered := readRegisteredMinors(map[string]string{"c": sysDir})
+	assert.Equal(t, 3, len(registered[deviceMajor{devType: "c", major: 236}]))
+
+	rules := []specs.LinuxDeviceCgroup{{Allow: false, Access: "rwm"},
+		nodeRule(236, 0), nodeRule(237, 0), nodeRule(236, 1), nodeRule(236, 2), nodeRule(238, 0), nodeRule(239, 0)}
+	coalesced := coalesceDeviceCgroups(rules, registered)
+	assert.Equal(t, 5, len(coalesced))
+	assert.Nil(t, coalesced[1].Minor)
+	assert.Equal(t, int64(236), *coalesced[1].Major)
+
+	for key, minors := range registered {
+		for minor := range minors {
+			assert.Equal(t, isDeviceAllowed(rules, key.devType, key.major, minor),
+				isDeviceAllowed(coalesced, key.devType, key.major, minor), key, minor)
+		}
+	}
+	assert.True(t, isDeviceAllowed(coalesced, "c", 239, 0))
+	assert.False(t, isDeviceAllowed(coalesced, "c", 237, 1))
+}
+
+func TestSpecHash(t *testing.T) {
+	config := map[string]string{prestartHookKey: prestartHookDefault}
+	spec := &specs.Spec{Process: &specs.Process{Env: []string{"ASCEND_VISIBLE_DEVICES=0"}}}
+	assert.False(t, isSpecPatched(spec, config))
+	assert.Nil(t, markSpecPatched(spec, config))
+	assert.True(t, isSpecPatched(spec, config))
+
+	content, err := json.Marshal(spec)
+	assert.Nil(t, err)
+	reread := &specs.Spec{}
+	assert.Nil(t, json.Unmarshal(content, reread))
+	assert.True(t, isSpecPatched(reread, config))
+
+	assert.False(t, isSpecPatched(spec, map[string]string{prestartHookKey: prestartHookCli}))
+	reread.Process.Env = append(reread.Process.Env, "ASCEND_RUNTIME_OPTIONS=VIRTUAL")
+	assert.False(t, isSpecPatched(reread, config))
+}
+
+func TestPatchDedup(t *testing.T) {
+	spec := &specs.Spec{Linux: &specs.Linux{Resources: &specs.LinuxResources{}}, Hooks: &specs.Hooks{}}
+	major, minor := int64(236), int64(0)
+	rule := specs.LinuxDeviceCgroup{Allow: true, Type: "c", Major: &major, Minor: &minor, Access: "rwm"}
+	device := specs.LinuxDevice{Path: "/dev/davinci0", Type: "c", Major: major, Minor: minor}
+	hook := specs.Hook{Path: "/usr/local/bin/ascend-docker-destroy",
+		Args: []string{"ascend-docker-destroy", "0", "0", "100"}}
+	for i := 0; i < 2; i++ {
+		otherMinor := minor
+		appendDeviceCgroup(spec, specs.LinuxDeviceCgroup{Allow: true, Type: "c", Major: &major, Minor: &otherMinor,
+			Access: "rwm"})
+		appendLinuxDevice(spec, device)
+		spec.Hooks.Poststop = appendHook(spec.Hooks.Poststop, hook)
+	}
+	assert.Equal(t, 1, len(spec.Linux.Resources.Devices))
+	assert.Equal(t, 1, len(spec.Linux.Devices))
+	assert.Equal(t, 1, len(spec.Hooks.Poststop))
+
+	// a rule denied meanwhile is granted again
+	spec.Linux.Resources.Devices = append(spec.Linux.Resources.Devices,
+		specs.LinuxDeviceCgroup{Allow: false, Type: "c", Major: &major, Access: "rwm"})
+	appendDeviceCgroup(spec, rule)
+	assert.Equal(t, 3, len(spec.Linux.Resources.Devices))
+
+	otherHook := specs.Hook{Path: hook.Path, Args: []string{"ascend-docker-destroy", "0", "0", "101"}}
+	spec.Hooks.Poststop = appendHook(spec.Hooks.Poststop, otherHook)
+	assert.Equal(t, 2, len(spec.Hooks.Poststop))
+}
+
+func TestParseVnpuPool(t *testing.T) {
+	targets, err := parseVnpuPool("0:vir02:4, 1:vir04:2")
+	assert.Nil(t, err)
+	assert.Equal(t, map[poolKey]int{{device: 0, template: "vir02"}: 4, {device: 1, template: "vir04"}: 2}, targets)
+	targets, err = parseVnpuPool("")
+	assert.Nil(t, err)
+	assert.Equal(t, 0, len(targets))
+	for _, value := range []string{"0:vir02", "a:vir02:1", "0:vir02:0", "0:vir02:65", "0:vir02:1,0:vir02:2",
+		"0:vir2:1"} {
+		_, err = parseVnpuPool(value)
+		assert.NotNil(t, err, value)
+	}
+}
+
+func TestVnpuPool(t *testing.T) {
+	backend := &fakeDcmiBackend{}
+	key := poolKey{device: 0, template: "vir02"}
+	daemon := newRuntimeDaemon(backend, map[poolKey]int{key: 2}, 0)
+	daemon.refillPool()
+	assert.Equal(t, 2, backend.created)
+	assert.Equal(t, 2, len(daemon.pool.ready[key]))
+
+	resp := daemon.handle(daemonRequest{Op: opCreateVDevice, Env: []string{"ASCEND_VNPU_SPECS=vir02"},
+		Devices: []int{0}})
+	assert.Equal(t, "", resp.Error)
+	leased := *resp.VDevice
+	assert.Equal(t, 2, backend.created)
+	assert.Equal(t, 1, len(daemon.pool.ready[key]))
+	assert.Equal(t, key, daemon.ledger[leased].pool)
+
+	// another template is split on demand and destroyed on release
+	resp = daemon.handle(daemonRequest{Op: opCreateVDevice, Env: []string{"ASCEND_VNPU_SPECS=vir04"},
+		Devices: []int{0}})
+	other := *resp.VDevice
+	assert.Equal(t, 3, backend.created)
+
+	resp = daemon.handle(daemonRequest{Op: opReleaseVDevice, VDevice: &leased})
+	assert.Equal(t, "", resp.Error)
+	assert.Equal(t, 2, len(daemon.pool.ready[key]))
+	assert.Equal(t, 0, len(backend.destroyed))
+	daemon.handle(daemonRequest{Op: opReleaseVDevice, VDevice: &other})
+	assert.Equal(t, []dcmi.VDeviceInfo{other}, backend.destroyed)
+	assert.Equal(t, 0, len(daemon.ledger))
+
+	daemon.drainPool()
+	assert.Equal(t, 3, len(backend.destroyed))
+	assert.Equal(t, 0, len(daemon.pool.ready[key]))
+}
+
+func TestReleaseThroughDaemonHook(t *testing.T) {
+	defer func(release bool) { releaseThroughDaemon = release }(releaseThroughDaemon)
+	releaseThroughDaemon = true
+	spec := &specs.Spec{Process: &specs.Process{}, Hooks: &specs.Hooks{}}
+	updateEnvAndPostHook(spec, dcmi.VDeviceInfo{CardID: 1, DeviceID: 0, VdeviceID: 102})
+	assert.Equal(t, 1, len(spec.Hooks.Poststop))
+	assert.Equal(t, []string{releaseVDeviceCmd, "1", "0", "102"}, spec.Hooks.Poststop[0].Args[1:])
+	vdevice, err := parseVDeviceArgs(spec.Hooks.Poststop[0].Args[2:])
+	assert.Nil(t, err)
+	assert.Equal(t, dcmi.VDeviceInfo{CardID: 1, DeviceID: 0, VdeviceID: 102}, vdevice)
+	_, err = parseVDeviceArgs([]string{"1", "-1", "2"})
+	assert.NotNil(t, err)
+	assert.False(t, isRuncPassthrough([]string{"ascend-docker-runtime", releaseVDeviceCmd, "1", "0", "102"}))
+}
+
+func TestGetLeaseID(t *testing.T) {
+	spec := &specs.Spec{Process: &specs.Process{Env: []string{"ASCEND_VNPU_LEASE=train-0"}}}
+	assert.Equal(t, "", getLeaseID(spec))
+	spec.Annotations = map[string]string{"io.kubernetes.cri.sandbox-uid": "1234",
+		"io.kubernetes.cri.container-name": "infer"}
+	assert.Equal(t, "1234/infer", getLeaseID(spec))
+	assert.Equal(t, "", getLeaseID(&specs.Spec{}))
+
+	_, err := parseLeaseTTL("-1")
+	assert.NotNil(t, err)
+	ttl, err := parseLeaseTTL("300")
+	assert.Nil(t, err)
+	assert.Equal(t, 5*time.Minute, ttl)
+}
+
+func TestVnpuLease(t *testing.T) {
+	backend := &fakeDcmiBackend{}
+	daemon := newRuntimeDaemon(backend, nil, time.Minute)
+	now := time.Now()
+	daemon.now = func() time.Time { return now }
+	create := func(template string) dcmi.VDeviceInfo {
+		resp := daemon.handle(daemonRequest{Op: opCreateVDevice, Env: []string{"ASCEND_VNPU_SPECS=" + template},
+			Devices: []int{0}, Lease: "1234/infer"})
+		assert.Equal(t, "", resp.Error)
+		return *resp.VDevice
+	}
+
+	first := create("vir02")
+	daemon.handle(daemonRequest{Op: opReleaseVDevice, VDevice: &first})
+	assert.Equal(t, 0, len(backend.destroyed))
+	assert.Equal(t, 1, len(daemon.leases))
+
+	// the restarted container gets its vNPU back
+	assert.Equal(t, first, create("vir02"))
+	assert.Equal(t, 1, backend.created)
+	daemon.handle(daemonRequest{Op: opReleaseVDevice, VDevice: &first})
+
+	// another template cannot reuse it
+	second := create("vir04")
+	assert.Equal(t, 2, backend.created)
+	assert.Equal(t, []dcmi.VDeviceInfo{first}, backend.destroyed)
+	daemon.handle(daemonRequest{Op: opReleaseVDevice, VDevice: &second})
+
+	daemon.sweepLeases()
+	assert.Equal(t, 1, len(daemon.leases))
+	now = now.Add(time.Minute)
+	daemon.sweepLeases()
+	assert.Equal(t, 0, len(daemon.leases))
+	assert.Equal(t, []dcmi.VDeviceInfo{first, second}, backend.destroyed)
+}
+
+func TestDestroyQueue(t *testing.T) {
+	dir := t.TempDir() + "/destroy-queue"
+	queue, err := newDestroyQueue(dir)
+	assert.Nil(t, err)
+	backend := &fakeDcmiBackend{destroyErr: fmt.Errorf("busy")}
+	daemon := newRuntimeDaemon(backend, nil, 0)
+	daemon.queue = queue
+	now := time.Now()
+	daemon.now = func() time.Time { return now }
+
+	vdevices := []dcmi.VDeviceInfo{{CardID: 1, DeviceID: 0, VdeviceID: 100}, {CardID: 0, DeviceID: 0, VdeviceID: 101}}
+	for i := range vdevices {
+		resp := daemon.handle(daemonRequest{Op: opReleaseVDevice, VDevice: &vdevices[i]})
+		assert.Equal(t, "", resp.Error)
+	}
+	assert.Equal(t, 2, queue.status().Depth)
+
+	// a new daemon finds what is queued on disk
+	queue, err = newDestroyQueue(dir)
+	assert.Nil(t, err)
+	daemon.queue = queue
+	assert.Equal(t, 2, queue.status().Depth)
+
+	daemon.drainDestroyQueue()
+	assert.Equal(t, 2, queue.status().Failures)
+	backend.destroyErr = nil
+	daemon.drainDestroyQueue()
+	assert.Equal(t, 0, len(backend.destroyed))
+	now = now.Add(minDestroyRetry)
+	daemon.drainDestroyQueue()
+	assert.Equal(t, []dcmi.VDeviceInfo{vdevices[1], vdevices[0]}, backend.destroyed)
+	assert.Equal(t, 0, queue.status().Depth)
+	assert.Equal(t, 2, queue.status().Destroyed)
+	files, err := ioutil.ReadDir(dir)
+	assert.Nil(t, err)
+	assert.Equal(t, 0, len(files))
+
+	resp := daemon.handle(daemonRequest{Op: opStatus})
+	status := daemonStatus{}
+	assert.Nil(t, json.Unmarshal([]byte(resp.Value), &status))
+	assert.Equal(t, 2, status.DestroyQueue.Destroyed)
+}
+
+func TestDestroyQueueAbandons(t *testing.T) {
+	dir := t.TempDir() + "/destroy-queue"
+	queue, err := newDestroyQueue(dir)
+	assert.Nil(t, err)
+	backend := &fakeDcmiBackend{destroyErr: fmt.Errorf("not found")}
+	daemon := newRuntimeDaemon(backend, nil, 0)
+	daemon.queue = queue
+	now := time.Now()
+	daemon.now = func() time.Time { return now }
+
+	vdevice := dcmi.VDeviceInfo{CardID: 1, DeviceID: 0, VdeviceID: 100}
+	assert.Nil(t, queue.push(vdevice))
+	for i := 0; i < maxDestroyAttempts; i++ {
+		daemon.drainDestroyQueue()
+		now = now.Add(maxDestroyRetry)
+	}
+	status := queue.status()
+	assert.Equal(t, 0, status.Depth)
+	assert.Equal(t, maxDestroyAttempts, status.Failures)
+	assert.Equal(t, []string{vdeviceFileName(vdevice)}, status.Abandoned)
+	daemon.drainDestroyQueue()
+	assert.Equal(t, maxDestroyAttempts, queue.status().Failures)
+
+	// a new daemon neither retries nor forgets an abandoned vNPU
+	queue, err = newDestroyQueue(dir)
+	assert.Nil(t, err)
+	assert.Equal(t, 0, queue.status().Depth)
+	assert.Equal(t, []string{vdeviceFileName(vdevice)}, queue.status().Abandoned)
+}
+
+func TestIdleVnpusOutliveDaemon(t *testing.T) {
+	idleDir := t.TempDir() + "/idle-vnpus"
+	queue, err := newDestroyQueue(t.TempDir() + "/destroy-queue")
+	assert.Nil(t, err)
+	assert.Nil(t, recoverIdleVnpus(idleDir, queue))
+	backend := &fakeDcmiBackend{}
+	key := poolKey{device: 0, template: "vir02"}
+	daemon := newRuntimeDaemon(backend, map[poolKey]int{key: 2}, time.Minute)
+	daemon.queue = queue
+	daemon.idleDir = idleDir
+	daemon.refillPool()
+	files, err := ioutil.ReadDir(idleDir)
+	assert.Nil(t, err)
+	assert.Equal(t, 2, len(files))
+
+	annotations := map[string]string{"io.kubernetes.cri.sandbox-uid": "1234",
+		"io.kubernetes.cri.container-name": "infer"}
+	resp := daemon.handle(daemonRequest{Op: opCreateVDevice, Env: []string{"ASCEND_VNPU_SPECS=vir02"},
+		Devices: []int{0}, Lease: getLeaseID(&specs.Spec{Annotations: annotations})})
+	assert.Equal(t, "", resp.Error)
+	files, err = ioutil.ReadDir(idleDir)
+	assert.Nil(t, err)
+	assert.Equal(t, 1, len(files))
+	// the released vNPU is kept for the lease of its container
+	daemon.handle(daemonRequest{Op: opReleaseVDevice, VDevice: resp.VDevice})
+	files, err = ioutil.ReadDir(idleDir)
+	assert.Nil(t, err)
+	assert.Equal(t, 2, len(files))
+
+	// the daemon is killed, the next one queues what it recorded
+	assert.Nil(t, recoverIdleVnpus(idleDir, queue))
+	assert.Equal(t, 2, queue.status().Depth)
+	files, err = ioutil.ReadDir(idleDir)
+	assert.Nil(t, err)
+	assert.Equal(t, 0, len(files))
+}
@@ -0,0 +1,200 @@
+/* Copyright(C) 2022. Huawei Technologies Co.,Ltd. All rights reserved.
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Package main
+package main
+
+import (
+	"fmt"
+	"path/filepath"
+	"strings"
+	"syscall"
+
+	"github.com/opencontainers/runtime-spec/specs-go"
+	"huawei.com/npu-exporter/v5/common-utils/hwlog"
+
+	"mindxcheckutils"
+)
+
+const (
+	ascendRuntimeMounts = "ASCEND_RUNTIME_MOUNTS"
+	ascendAllowLink     = "ASCEND_ALLOW_LINK"
+
+	mountModeKey     = "mount-mode"
+	mountModeHook    = "hook"
+	mountModeSpec    = "spec"
+	specMountType    = "bind"
+	allowLinkTrue    = "True"
+	allowLinkFalse   = "False"
+	optionNoDriver   = "NODRV"
+	optionVirtual    = "VIRTUAL"
+	optionStaging    = "STAGING"
+	optionCopyIn     = "COPYIN"
+	runtimeOptionMax = 128
+	cliMountFileArg  = "--mount-file"
+	cliMountDirArg   = "--mount-dir"
+)
+
+var mountConfigDir = mindxcheckutils.MountProfileDir
+
+// getMountMode returns how the driver files reach the container, "hook" mounts them in the prestart hook,
+// "spec" lists them in the mounts of the OCI spec and lets runc bind them
+func getMountMode(config map[string]string) (string, error) {
+	switch config[mountModeKey] {
+	case "", mountModeHook:
+		return mountModeHook, nil
+	case mountModeSpec:
+		return mountModeSpec, nil
+	default:
+		return "", fmt.Errorf("invalid %s in runtime config", mountModeKey)
+	}
+}
+
+func parseRuntimeOptions(runtimeOptions string) (map[string]bool, error) {
+	options := make(map[string]bool)
+	if runtimeOptions == "" {
+		return options, nil
+	}
+	if len(runtimeOptions) > runtimeOptionMax {
+		return nil, fmt.Errorf("invalid runtime option")
+	}
+	for _, option := range strings.Split(runtimeOptions, ",") {
+		option = strings.TrimSpace(option)
+		switch option {
+		case optionNoDriver, optionVirtual, optionStaging, optionCopyIn:
+			options[option] = true
+		default:
+			return nil, fmt.Errorf("invalid runtime option")
+		}
+	}
+	return options, nil
+}
+
+// canMountBySpec reports whether the runtime options leave the mounts as plain read only binds,
+// staging trees and copied config files still need ascend-docker-cli
+func canMountBySpec(options map[string]bool) bool {
+	return !options[optionStaging] && !options[optionCopyIn]
+}
+
+func checkMountSource(sourcePath string, allowLink bool) (bool, error) {
+	if _, ok := mountWhiteList[sourcePath]; !ok {
+		return false, fmt.Errorf("failed to check white list value: %s", sourcePath)
+	}
+	flags := mindxcheckutils.OPath | syscall.O_CLOEXEC
+	if !allowLink {
+		flags |= syscall.O_NOFOLLOW
+	}
+	fd, err := syscall.Open(sourcePath, flags, 0)
+	if err == syscall.ENOENT {
+		return false, nil
+	}
+	if err != nil {
+		return false, fmt.Errorf("failed to open mount source %s: %v", sourcePath, err)
+	}
+	defer syscall.Close(fd)
+	if err := mindxcheckutils.MountSourceChecker(fd, sourcePath, allowLink); err != nil {
+		return false, err
+	}
+	return true, nil
+}
+
+// buildSpecMounts turns the checked sources into read only binds, destinations already in the spec are kept
+func buildSpecMounts(existing []specs.Mount, sources []string) []specs.Mount {
+	destinations := make(map[string]struct{}, len(existing))
+	for _, m := range existing {
+		destinations[filepath.Clean(m.Destination)] = struct{}{}
+	}
+	mounts := make([]specs.Mount, 0, len(sources))
+	for _, source := range sources {
+		if _, ok := destinations[source]; ok {
+			continue
+		}
+		destinations[source] = struct{}{}
+		mounts = append(mounts, specs.Mount{
+			Destination: source,
+			Type:        specMountType,
+			Source:      source,
+			Options:     []string{"bind", "ro", "nosuid"},
+		})
+	}
+	return mounts
+}
+
+// readDriverMountSources reads the mount profiles, and returns the normalized sources which pass the checks,
+// sources which no longer exist are skipped
+func readDriverMountSources(mounts string, allowLink bool) ([]string, error) {
+	fileMountList, dirMountList, err := mindxcheckutils.ReadMountProfiles(mountConfigDir,
+		mindxcheckutils.ParseMountProfiles(mounts))
+	if err != nil {
+		return nil, err
+	}
+	fileMountList, dirMountList, _ = mindxcheckutils.NormalizeMountLists(fileMountList, dirMountList)
+
+	sources := make([]string, 0, len(fileMountList)+len(dirMountList))
+	for _, sourcePath := range append(fileMountList, dirMountList...) {
+		exists, err := checkMountSource(sourcePath, allowLink)
+		if err != nil {
+			return nil, err
+		}
+		if exists {
+			sources = append(sources, sourcePath)
+		}
+	}
+	return sources, nil
+}
+
+// getCliMountArgs reads the mount profiles for ascend-docker-cli, which only checks the resolved lists
+// against its white list and no longer reads the profiles itself
+func getCliMountArgs(mounts string) ([]string, error) {
+	fileMountList, dirMountList, err := mindxcheckutils.ReadMountProfiles(mountConfigDir,
+		mindxcheckutils.ParseMountProfiles(mounts))
+	if err != nil {
+		return nil, err
+	}
+	fileMountList, dirMountList, _ = mindxcheckutils.NormalizeMountLists(fileMountList, dirMountList)
+
+	args := make([]string, 0, kvPairSize*(len(fileMountList)+len(dirMountList)))
+	for _, file := range fileMountList {
+		args = append(args, cliMountFileArg, file)
+	}
+	for _, dir := range dirMountList {
+		args = append(args, cliMountDirArg, dir)
+	}
+	return args, nil
+}
+
+// addSpecMounts checks the mount profiles once in the runtime and appends them to spec.Mounts,
+// so that no prestart hook is needed for containers without vNPU
+func addSpecMounts(spec *specs.Spec, options map[string]bool) error {
+	if options[optionNoDriver] {
+		return nil
+	}
+	allowLink := false
+	switch getValueByKey(spec.Process.Env, ascendAllowLink) {
+	case "", allowLinkFalse:
+	case allowLinkTrue:
+		allowLink = true
+	default:
+		return fmt.Errorf("invalid soft link option")
+	}
+
+	sources, err := readDriverMountSources(getValueByKey(spec.Process.Env, ascendRuntimeMounts), allowLink)
+	if err != nil {
+		return err
+	}
+	mounts := buildSpecMounts(spec.Mounts, sources)
+	spec.Mounts = append(spec.Mounts, mounts...)
+	hwlog.RunLog.Infof("%d driver mounts added to spec", len(mounts))
+	return nil
+}
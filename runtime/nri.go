@@ -0,0 +1,94 @@
+/* Copyright(C) 2022. Huawei Technologies Co.,Ltd. All rights reserved.
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Package main
+package main
+
+import (
+	"sync"
+
+	"github.com/opencontainers/runtime-spec/specs-go"
+)
+
+// containerAdjustment is the part of a container spec changed by ascend-docker-runtime, in the shape of the
+// adjustment an NRI plugin returns for CreateContainer
+type containerAdjustment struct {
+	Env           []string
+	Mounts        []specs.Mount
+	Devices       []specs.LinuxDevice
+	DeviceCgroups []specs.LinuxDeviceCgroup
+	Prestart      []specs.Hook
+	Poststop      []specs.Hook
+}
+
+// nriPlugin computes container adjustments in a long lived process, the DCMI answers which do not change
+// while the driver is loaded are kept in memory
+type nriPlugin struct {
+	// the spec logic keeps its state in package variables, so requests are handled one by one
+	mu sync.Mutex
+}
+
+// warmDcmiQueries swaps the DCMI queries for cached ones the first time a plugin is made
+var warmDcmiQueries sync.Once
+
+// newNriPlugin makes a plugin for a long lived process, the chip name and the product type are read from DCMI
+// once for the life of the process
+func newNriPlugin() *nriPlugin {
+	warmDcmiQueries.Do(func() {
+		getChipName = cachedDcmiQuery(getChipName)
+		getProductType = cachedDcmiQuery(getProductType)
+	})
+	return &nriPlugin{}
+}
+
+// CreateContainer returns the adjustment for a container with env and mounts, the same changes as the ones
+// modifySpecFile makes to config.json
+func (p *nriPlugin) CreateContainer(env []string, mounts []specs.Mount) (*containerAdjustment, error) {
+	p.mu.Lock()
+	defer p.mu.Unlock()
+
+	spec := &specs.Spec{
+		Process: &specs.Process{Env: append([]string{}, env...)},
+		Mounts:  append([]specs.Mount{}, mounts...),
+		Hooks:   &specs.Hooks{},
+		Linux:   &specs.Linux{Resources: &specs.LinuxResources{}},
+	}
+	deviceIdList = nil
+	if err := applyAscendSpec(spec); err != nil {
+		return nil, err
+	}
+	return getAdjustment(env, len(mounts), spec), nil
+}
+
+// getAdjustment collects what applyAscendSpec added to a spec which started with env and mountCount mounts,
+// changed env entries are returned as new entries of the same key
+func getAdjustment(env []string, mountCount int, spec *specs.Spec) *containerAdjustment {
+	knownEnv := make(map[string]struct{}, len(env))
+	for _, e := range env {
+		knownEnv[e] = struct{}{}
+	}
+	adjust := &containerAdjustment{
+		Mounts:        spec.Mounts[mountCount:],
+		Devices:       spec.Linux.Devices,
+		DeviceCgroups: spec.Linux.Resources.Devices,
+		Prestart:      spec.Hooks.Prestart,
+		Poststop:      spec.Hooks.Poststop,
+	}
+	for _, e := range spec.Process.Env {
+		if _, ok := knownEnv[e]; !ok {
+			adjust.Env = append(adjust.Env, e)
+		}
+	}
+	return adjust
+}
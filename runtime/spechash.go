@@ -0,0 +1,130 @@
+/* Copyright(C) 2022. Huawei Technologies Co.,Ltd. All rights reserved.
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Package main
+package main
+
+import (
+	"crypto/sha256"
+	"encoding/hex"
+	"encoding/json"
+	"sort"
+
+	"github.com/opencontainers/runtime-spec/specs-go"
+)
+
+// specHashKey is the annotation of the specs patched by ascend-docker-runtime
+const specHashKey = "ascend.com/spec-hash"
+
+// getSpecHash hashes spec without its hash annotation, together with the runtime config, a spec patched under
+// another config is patched again
+func getSpecHash(spec *specs.Spec, config map[string]string) (string, error) {
+	unmarked := *spec
+	unmarked.Annotations = make(map[string]string, len(spec.Annotations))
+	for k, v := range spec.Annotations {
+		if k != specHashKey {
+			unmarked.Annotations[k] = v
+		}
+	}
+	content, err := json.Marshal(&unmarked)
+	if err != nil {
+		return "", err
+	}
+	keys := make([]string, 0, len(config))
+	for k := range config {
+		keys = append(keys, k)
+	}
+	sort.Strings(keys)
+
+	h := sha256.New()
+	h.Write(content)
+	for _, k := range keys {
+		h.Write([]byte("\n" + k + "=" + config[k]))
+	}
+	return hex.EncodeToString(h.Sum(nil)), nil
+}
+
+// isSpecPatched reports whether spec is unchanged since ascend-docker-runtime patched it, such as when runc
+// create is retried on the same bundle
+func isSpecPatched(spec *specs.Spec, config map[string]string) bool {
+	recorded, ok := spec.Annotations[specHashKey]
+	if !ok {
+		return false
+	}
+	current, err := getSpecHash(spec, config)
+	return err == nil && current == recorded
+}
+
+func markSpecPatched(spec *specs.Spec, config map[string]string) error {
+	hash, err := getSpecHash(spec, config)
+	if err != nil {
+		return err
+	}
+	if spec.Annotations == nil {
+		spec.Annotations = make(map[string]string)
+	}
+	spec.Annotations[specHashKey] = hash
+	return nil
+}
+
+func deviceCgroupEqual(a, b specs.LinuxDeviceCgroup) bool {
+	equalNum := func(x, y *int64) bool {
+		return (x == nil && y == nil) || (x != nil && y != nil && *x == *y)
+	}
+	return a.Allow == b.Allow && a.Type == b.Type && a.Access == b.Access && equalNum(a.Major, b.Major) &&
+		equalNum(a.Minor, b.Minor)
+}
+
+// appendDeviceCgroup appends rule unless the same rule is already in the spec and no deny rule follows it
+func appendDeviceCgroup(spec *specs.Spec, rule specs.LinuxDeviceCgroup) {
+	rules := spec.Linux.Resources.Devices
+	for i := len(rules) - 1; i >= 0; i-- {
+		if deviceCgroupEqual(rules[i], rule) {
+			return
+		}
+		if !rules[i].Allow {
+			break
+		}
+	}
+	spec.Linux.Resources.Devices = append(spec.Linux.Resources.Devices, rule)
+}
+
+// appendLinuxDevice appends device unless a device with the same path in the container is already in the spec
+func appendLinuxDevice(spec *specs.Spec, device specs.LinuxDevice) {
+	for _, existing := range spec.Linux.Devices {
+		if existing.Path == device.Path {
+			return
+		}
+	}
+	spec.Linux.Devices = append(spec.Linux.Devices, device)
+}
+
+func appendHook(hooks []specs.Hook, hook specs.Hook) []specs.Hook {
+	for _, existing := range hooks {
+		if existing.Path != hook.Path || len(existing.Args) != len(hook.Args) {
+			continue
+		}
+		same := true
+		for i := range hook.Args {
+			if existing.Args[i] != hook.Args[i] {
+				same = false
+				break
+			}
+		}
+		if same {
+			return hooks
+		}
+	}
+	return append(hooks, hook)
+}
@@ -0,0 +1,139 @@
+/* Copyright(C) 2022. Huawei Technologies Co.,Ltd. All rights reserved.
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Package main
+package main
+
+import (
+	"fmt"
+	"strconv"
+	"time"
+
+	"github.com/opencontainers/runtime-spec/specs-go"
+	"huawei.com/npu-exporter/v5/common-utils/hwlog"
+
+	"main/dcmi"
+)
+
+const (
+	// vnpuLeaseTTLKey is the number of seconds a stopped container keeps its vNPU for its restart, 0 disables it
+	vnpuLeaseTTLKey = "vnpu-lease-ttl"
+	maxVnpuLeaseTTL = 24 * time.Hour
+)
+
+// podIdentityAnnotations are the annotations of the pod uid and the container name, set by containerd and CRI-O,
+// nothing inside the container can choose them
+var podIdentityAnnotations = [][2]string{
+	{"io.kubernetes.cri.sandbox-uid", "io.kubernetes.cri.container-name"},
+	{"io.kubernetes.pod.uid", "io.kubernetes.container.name"},
+}
+
+// ledgerEntry is what the daemon knows of a vNPU it handed out
+type ledgerEntry struct {
+	pool  poolKey
+	lease string
+}
+
+// vnpuLease is a vNPU kept for the restart of the container which released it
+type vnpuLease struct {
+	key     poolKey
+	vdevice dcmi.VDeviceInfo
+	expire  time.Time
+}
+
+// getLeaseID returns the identity of the container across its restarts, empty if it has none, the env of the
+// container is not used since another workload could claim a lease through it
+func getLeaseID(spec *specs.Spec) string {
+	for _, names := range podIdentityAnnotations {
+		uid, container := spec.Annotations[names[0]], spec.Annotations[names[1]]
+		if uid != "" && container != "" {
+			return uid + "/" + container
+		}
+	}
+	return ""
+}
+
+func parseLeaseTTL(value string) (time.Duration, error) {
+	if value == "" {
+		return 0, nil
+	}
+	seconds, err := strconv.Atoi(value)
+	ttl := time.Duration(seconds) * time.Second
+	if err != nil || seconds < 0 || ttl > maxVnpuLeaseTTL {
+		return 0, fmt.Errorf("invalid %s in runtime config", vnpuLeaseTTLKey)
+	}
+	return ttl, nil
+}
+
+// retire gives a vNPU no one uses any more to its pool, or destroys it, d.mu is held
+func (d *runtimeDaemon) retire(key poolKey, vdevice dcmi.VDeviceInfo) error {
+	if d.pool.giveBack(key, vdevice) {
+		d.markIdle(vdevice)
+		hwlog.RunLog.Infof("vNPU %v returned to the pool of %v", vdevice, key)
+		return nil
+	}
+	if err := d.destroyLater(vdevice); err != nil {
+		return err
+	}
+	d.unmarkIdle(vdevice)
+	return nil
+}
+
+// takeLease returns the vNPU kept for id if it was split the way key asks, d.mu is held
+func (d *runtimeDaemon) takeLease(id string, key poolKey) (dcmi.VDeviceInfo, bool) {
+	lease, ok := d.leases[id]
+	if !ok {
+		return dcmi.VDeviceInfo{}, false
+	}
+	delete(d.leases, id)
+	if lease.key != key {
+		hwlog.RunLog.Infof("vNPU lease %s is %v, %v is asked for", id, lease.key, key)
+		if err := d.retire(lease.key, lease.vdevice); err != nil {
+			hwlog.RunLog.Warnf("failed to destroy vNPU %v of lease %s: %v", lease.vdevice, id, err)
+		}
+		return dcmi.VDeviceInfo{}, false
+	}
+	d.unmarkIdle(lease.vdevice)
+	return lease.vdevice, true
+}
+
+// keepLease keeps a released vNPU for the restart of its container, d.mu is held
+func (d *runtimeDaemon) keepLease(id string, key poolKey, vdevice dcmi.VDeviceInfo) {
+	if old, ok := d.leases[id]; ok {
+		if err := d.retire(old.key, old.vdevice); err != nil {
+			hwlog.RunLog.Warnf("failed to destroy vNPU %v of lease %s: %v", old.vdevice, id, err)
+		}
+	}
+	d.leases[id] = vnpuLease{key: key, vdevice: vdevice, expire: d.now().Add(d.leaseTTL)}
+	d.markIdle(vdevice)
+	hwlog.RunLog.Infof("vNPU %v kept for lease %s for %v", vdevice, id, d.leaseTTL)
+}
+
+// sweepLeases retires the vNPUs whose container was not restarted in time
+func (d *runtimeDaemon) sweepLeases() {
+	d.mu.Lock()
+	defer d.mu.Unlock()
+	now := d.now()
+	for id, lease := range d.leases {
+		if now.Before(lease.expire) {
+			continue
+		}
+		delete(d.leases, id)
+		if err := d.retire(lease.key, lease.vdevice); err != nil {
+			hwlog.RunLog.Warnf("failed to destroy vNPU %v of expired lease %s: %v", lease.vdevice, id, err)
+			continue
+		}
+		hwlog.RunLog.Infof("vNPU lease %s expired", id)
+	}
+}
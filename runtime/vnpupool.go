@@ -0,0 +1,325 @@
+/* Copyright(C) 2022. Huawei Technologies Co.,Ltd. All rights reserved.
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Package main
+package main
+
+import (
+	"fmt"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"strings"
+	"time"
+
+	"github.com/opencontainers/runtime-spec/specs-go"
+	"huawei.com/npu-exporter/v5/common-utils/hwlog"
+
+	"main/dcmi"
+)
+
+const (
+	// vnpuPoolKey lists the vNPUs the runtime daemon keeps split ahead, such as "0:vir02:4,1:vir04:2", each item
+	// is the physical id of a device, a template and the number of vNPUs
+	vnpuPoolKey        = "vnpu-pool"
+	vnpuPoolItemSize   = 3
+	maxVnpuPoolSize    = 64
+	vnpuPoolRefillTime = 10 * time.Second
+	vnpuSpecsEnv       = "ASCEND_VNPU_SPECS"
+
+	releaseVDeviceCmd = "release-vdevice"
+	releaseParamsNum  = 3
+
+	// idleVnpuPath holds one empty file per vNPU in a pool or a lease, named like the destroy queue, the vNPUs a
+	// daemon which did not stop cleanly left there are destroyed by the next one
+	idleVnpuPath = "/run/ascend-docker-runtime/idle-vnpus"
+	idleVnpuMode = 0600
+)
+
+var idleVnpuDir = idleVnpuPath
+
+// poolKey tells which vNPUs can stand for each other, the ones split with one template on one device
+type poolKey struct {
+	device   int
+	template string
+}
+
+func (k poolKey) String() string {
+	return fmt.Sprintf("%s on device %d", k.template, k.device)
+}
+
+func (k poolKey) toSpec() *specs.Spec {
+	return &specs.Spec{Process: &specs.Process{Env: []string{vnpuSpecsEnv + "=" + k.template}}}
+}
+
+// vnpuPool holds the vNPUs split ahead and not leased, per template and device
+type vnpuPool struct {
+	targets map[poolKey]int
+	ready   map[poolKey][]dcmi.VDeviceInfo
+	refill  chan struct{}
+}
+
+func newVnpuPool(targets map[poolKey]int) *vnpuPool {
+	return &vnpuPool{
+		targets: targets,
+		ready:   make(map[poolKey][]dcmi.VDeviceInfo),
+		refill:  make(chan struct{}, 1),
+	}
+}
+
+// parseVnpuPool parses the vnpu-pool value of the runtime config
+func parseVnpuPool(value string) (map[poolKey]int, error) {
+	targets := make(map[poolKey]int)
+	if strings.TrimSpace(value) == "" {
+		return targets, nil
+	}
+	for _, item := range strings.Split(value, ",") {
+		words := strings.Split(strings.TrimSpace(item), ":")
+		if len(words) != vnpuPoolItemSize {
+			return nil, fmt.Errorf("invalid %s item: %s", vnpuPoolKey, item)
+		}
+		device, ok := parseDeviceId(words[0])
+		if !ok {
+			return nil, fmt.Errorf("invalid device of %s item: %s", vnpuPoolKey, item)
+		}
+		count, ok := parseDeviceId(words[2])
+		if !ok || count == 0 || count > maxVnpuPoolSize {
+			return nil, fmt.Errorf("invalid size of %s item: %s", vnpuPoolKey, item)
+		}
+		if !dcmi.IsValidVpuTemplate(words[1]) {
+			return nil, fmt.Errorf("invalid template of %s item: %s", vnpuPoolKey, item)
+		}
+		key := poolKey{device: device, template: words[1]}
+		if _, ok := targets[key]; ok {
+			return nil, fmt.Errorf("duplicated %s item: %s", vnpuPoolKey, item)
+		}
+		targets[key] = count
+	}
+	return targets, nil
+}
+
+// getPoolKey returns the pool a create request may lease from
+func getPoolKey(env []string, devices []int) (poolKey, bool) {
+	template := getValueByKey(env, vnpuSpecsEnv)
+	if template == "" || len(devices) != 1 {
+		return poolKey{}, false
+	}
+	return poolKey{device: devices[0], template: template}, true
+}
+
+func (p *vnpuPool) wake() {
+	select {
+	case p.refill <- struct{}{}:
+	default:
+	}
+}
+
+// lease takes a ready vNPU of key, d.mu is held
+func (p *vnpuPool) lease(key poolKey) (dcmi.VDeviceInfo, bool) {
+	ready := p.ready[key]
+	if len(ready) == 0 {
+		return dcmi.VDeviceInfo{}, false
+	}
+	vdevice := ready[len(ready)-1]
+	p.ready[key] = ready[:len(ready)-1]
+	p.wake()
+	return vdevice, true
+}
+
+// giveBack keeps a released vNPU of key if its pool is short, d.mu is held
+func (p *vnpuPool) giveBack(key poolKey, vdevice dcmi.VDeviceInfo) bool {
+	if len(p.ready[key]) >= p.targets[key] {
+		return false
+	}
+	p.ready[key] = append(p.ready[key], vdevice)
+	return true
+}
+
+// shortKey returns a pool which has fewer ready vNPUs than configured, d.mu is held
+func (p *vnpuPool) shortKey() (poolKey, bool) {
+	for key, target := range p.targets {
+		if len(p.ready[key]) < target {
+			return key, true
+		}
+	}
+	return poolKey{}, false
+}
+
+// refillPool splits vNPUs until every pool is full, d.mu is taken per vNPU so requests are served meanwhile,
+// the round stops at the first failure and is tried again later
+func (d *runtimeDaemon) refillPool() {
+	for {
+		d.mu.Lock()
+		key, short := d.pool.shortKey()
+		if !short {
+			d.mu.Unlock()
+			return
+		}
+		start := time.Now()
+		vdevice, err := d.backend.CreateVDevice(key.toSpec(), []int{key.device})
+		if err == nil && vdevice.VdeviceID == -1 {
+			err = fmt.Errorf("no vdevice created")
+		}
+		if err != nil {
+			d.mu.Unlock()
+			hwlog.RunLog.Warnf("failed to split a vNPU of %v for the pool: %v", key, err)
+			return
+		}
+		d.pool.ready[key] = append(d.pool.ready[key], vdevice)
+		d.markIdle(vdevice)
+		hwlog.RunLog.Infof("vNPU %v of %v added to the pool in %v, %d ready", vdevice, key, time.Since(start),
+			len(d.pool.ready[key]))
+		d.mu.Unlock()
+	}
+}
+
+// maintainPool refills the pool after each lease and periodically, and retires the expired vNPU leases, until
+// stop is closed
+func (d *runtimeDaemon) maintainPool(stop <-chan struct{}) {
+	ticker := time.NewTicker(vnpuPoolRefillTime)
+	defer ticker.Stop()
+	for {
+		d.sweepLeases()
+		d.refillPool()
+		select {
+		case <-stop:
+			return
+		case <-d.pool.refill:
+		case <-ticker.C:
+		}
+	}
+}
+
+// drainPool destroys the vNPUs which are not in use, the ones in use are destroyed when they are released
+func (d *runtimeDaemon) drainPool() {
+	d.mu.Lock()
+	defer d.mu.Unlock()
+	for id, lease := range d.leases {
+		if err := d.backend.DestroyVDevice(lease.vdevice); err != nil {
+			hwlog.RunLog.Warnf("failed to destroy vNPU %v of lease %s: %v", lease.vdevice, id, err)
+		} else {
+			d.unmarkIdle(lease.vdevice)
+		}
+		delete(d.leases, id)
+	}
+	for key, ready := range d.pool.ready {
+		for _, vdevice := range ready {
+			if err := d.backend.DestroyVDevice(vdevice); err != nil {
+				hwlog.RunLog.Warnf("failed to destroy pooled vNPU %v: %v", vdevice, err)
+			} else {
+				d.unmarkIdle(vdevice)
+			}
+		}
+		delete(d.pool.ready, key)
+	}
+}
+
+// markIdle records on disk that vdevice is in a pool or a lease, so that it is not lost with the daemon, d.mu
+// is held
+func (d *runtimeDaemon) markIdle(vdevice dcmi.VDeviceInfo) {
+	if d.idleDir == "" {
+		return
+	}
+	name := filepath.Join(d.idleDir, vdeviceFileName(vdevice))
+	if err := ioutil.WriteFile(name, nil, idleVnpuMode); err != nil {
+		hwlog.RunLog.Warnf("failed to record idle vNPU %v: %v", vdevice, err)
+	}
+}
+
+// unmarkIdle is called once vdevice is in use again or queued to be destroyed, d.mu is held
+func (d *runtimeDaemon) unmarkIdle(vdevice dcmi.VDeviceInfo) {
+	if d.idleDir == "" {
+		return
+	}
+	if err := os.Remove(filepath.Join(d.idleDir, vdeviceFileName(vdevice))); err != nil && !os.IsNotExist(err) {
+		hwlog.RunLog.Warnf("failed to remove the record of idle vNPU %v: %v", vdevice, err)
+	}
+}
+
+// recoverIdleVnpus queues the vNPUs recorded in dir to be destroyed, the pools and the leases they belonged to
+// were lost with the daemon which recorded them
+func recoverIdleVnpus(dir string, queue *destroyQueue) error {
+	if err := makeStateDir(dir); err != nil {
+		return err
+	}
+	idle, err := readVDeviceFiles(dir)
+	if err != nil {
+		return err
+	}
+	for vdevice := range idle {
+		if err := queue.push(vdevice); err != nil {
+			return err
+		}
+		if err := os.Remove(filepath.Join(dir, vdeviceFileName(vdevice))); err != nil && !os.IsNotExist(err) {
+			return fmt.Errorf("failed to remove the record of idle vNPU %v: %v", vdevice, err)
+		}
+	}
+	if len(idle) != 0 {
+		hwlog.RunLog.Infof("%d idle vNPUs left by the previous daemon queued to be destroyed", len(idle))
+	}
+	return nil
+}
+
+// releaseVDevice keeps a vNPU created through the daemon for the restart of its container, or gives it back to
+// its pool, or queues it to be destroyed, d.mu is held
+func (d *runtimeDaemon) releaseVDevice(vdevice dcmi.VDeviceInfo) error {
+	entry, ok := d.ledger[vdevice]
+	if !ok {
+		return d.destroyLater(vdevice)
+	}
+	if entry.lease != "" {
+		delete(d.ledger, vdevice)
+		d.keepLease(entry.lease, entry.pool, vdevice)
+		return nil
+	}
+	if err := d.retire(entry.pool, vdevice); err != nil {
+		return err
+	}
+	delete(d.ledger, vdevice)
+	return nil
+}
+
+func parseVDeviceArgs(cmdArgs []string) (dcmi.VDeviceInfo, error) {
+	if len(cmdArgs) != releaseParamsNum {
+		return dcmi.VDeviceInfo{}, fmt.Errorf("usage: %s <card id> <device id> <vdevice id>", releaseVDeviceCmd)
+	}
+	ids := make([]int32, releaseParamsNum)
+	for i, arg := range cmdArgs {
+		id, ok := parseDeviceId(arg)
+		if !ok {
+			return dcmi.VDeviceInfo{}, fmt.Errorf("invalid id: %s", arg)
+		}
+		ids[i] = int32(id)
+	}
+	return dcmi.VDeviceInfo{CardID: ids[0], DeviceID: ids[1], VdeviceID: ids[2]}, nil
+}
+
+// runReleaseVDevice is the Poststop hook of the vNPUs created through the daemon, the vNPU is destroyed
+// directly if the daemon is gone
+func runReleaseVDevice(cmdArgs []string) error {
+	vdevice, err := parseVDeviceArgs(cmdArgs)
+	if err != nil {
+		return err
+	}
+	_, err = callDaemon(daemonRequest{Op: opReleaseVDevice, VDevice: &vdevice})
+	if err != errDaemonAbsent {
+		return err
+	}
+	worker := &dcmi.NpuWorker{}
+	if err := worker.Initialize(); err != nil {
+		return fmt.Errorf("cannot init dcmi : %v", err)
+	}
+	defer worker.ShutDown()
+	return worker.DestroyVDevice(vdevice.CardID, vdevice.DeviceID, vdevice.VdeviceID)
+}
@@ -0,0 +1,34 @@
+/* Copyright(C) 2022. Huawei Technologies Co.,Ltd. All rights reserved.
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Package main
+package main
+
+// #cgo CFLAGS: -I${SRCDIR}/../cli/src
+// #include "white_list.h"
+// static const char *mountWhiteListEntry(int i) { return g_mountWhiteList[i]; }
+import "C"
+
+// mountWhiteList is the white list of ascend-docker-cli, read from the same C table
+var mountWhiteList = loadMountWhiteList()
+
+func loadMountWhiteList() map[string]struct{} {
+	list := make(map[string]struct{}, C.WHITE_LIST_NUM)
+	for i := 0; i < C.WHITE_LIST_NUM; i++ {
+		if entry := C.GoString(C.mountWhiteListEntry(C.int(i))); entry != "" {
+			list[entry] = struct{}{}
+		}
+	}
+	return list
+}